@@ -0,0 +1,57 @@
+#! /usr/bin/python3
+
+# Compares the results of 'make bench' with a baseline and exits with an
+# error if any benchmark got slower by more than the threshold. The fastest
+# sample of each benchmark is compared, since it varies the least between
+# runs.
+#
+# Usage: compare.py baseline.json results.json [threshold percent]
+
+
+import json
+import sys
+
+
+if len(sys.argv) < 3:
+    print("usage: compare.py baseline.json results.json [threshold percent]")
+    sys.exit(2)
+
+baseline_path = sys.argv[1]
+results_path = sys.argv[2]
+threshold = float(sys.argv[3]) if len(sys.argv) > 3 else 20.0
+
+
+def load(path):
+    with open(path, "r") as handle:
+        return {benchmark["name"]: benchmark for benchmark in json.load(handle)["benchmarks"]}
+
+
+baseline = load(baseline_path)
+results = load(results_path)
+regressions = 0
+
+print("%-24s %12s %12s %9s" % ("benchmark", "baseline ns", "current ns", "change"))
+
+for name, result in results.items():
+    if name not in baseline:
+        print("%-24s %12s %12.1f %9s" % (name, "-", result["min_ns"], "new"))
+        continue
+
+    before = baseline[name]["min_ns"]
+    after = result["min_ns"]
+    change = (after - before) / before * 100.0
+
+    flag = ""
+    if change > threshold:
+        flag = "  REGRESSION"
+        regressions += 1
+
+    print("%-24s %12.1f %12.1f %+8.1f%%%s" % (name, before, after, change, flag))
+
+for name in baseline:
+    if name not in results:
+        print("%-24s %12.1f %12s %9s" % (name, baseline[name]["min_ns"], "-", "missing"))
+
+if regressions > 0:
+    print("%d benchmark(s) slower than the baseline by more than %.0f%%" % (regressions, threshold))
+    sys.exit(1)
@@ -0,0 +1,152 @@
+/*
+ * File: bench_builtin_output.cc
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * Measures how a builtin that prints a lot of output performs. A history
+ * file with a given number of lines is generated, and each shell runs
+ * 'history' with its standard output going to a file. The time taken and
+ * the number of write system calls the shell made are reported, so an old
+ * and a new build of the shell can be compared directly.
+ *
+ * The system call count is read from /proc/PID/io while the finished shell
+ * is still a zombie, so this benchmark only runs on Linux.
+ *
+ * Usage: bench_builtin_output [number of lines] [path to josh...]
+ */
+
+
+#include <iostream>
+#include <string>
+#include <fstream>
+#include <chrono>
+
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+
+#define HISTORY_PATH "/tmp/bench_builtin_output_history"
+#define OUTPUT_PATH "/tmp/bench_builtin_output_out"
+
+
+typedef std::chrono::steady_clock bench_clock;
+
+
+static bool make_history(int lines)
+{
+    std::ofstream history(HISTORY_PATH, std::ios::trunc);
+
+    for(int i = 0; i < lines; i++)
+        history << "echo benchmark history entry " << i << "\n";
+
+    return history.good();
+}
+
+
+/*
+ * Reads the number of write system calls (write, writev, etc.) a process
+ * has made. The process must not have been reaped yet.
+ */
+static long read_write_syscalls(pid_t pid)
+{
+    std::ifstream io("/proc/" + std::to_string(pid) + "/io");
+    std::string key;
+    long value;
+
+    while(io >> key >> value)
+    {
+        if(key == "syscw:")
+            return value;
+    }
+
+    return -1;
+}
+
+
+static int run_shell(const char *josh)
+{
+    int input[2];
+    if(pipe(input) != 0)
+        return -1;
+
+    int output = open(OUTPUT_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(output < 0)
+        return -1;
+
+    auto start = bench_clock::now();
+    pid_t pid = fork();
+
+    if(pid < 0)
+        return -1;
+
+    if(pid == 0)
+    {
+        dup2(input[0], STDIN_FILENO);
+        dup2(output, STDOUT_FILENO);
+        close(input[0]);
+        close(input[1]);
+        close(output);
+
+        setenv("HISTFILE", HISTORY_PATH, 1);
+        execl(josh, josh, (char*) NULL);
+        _exit(127);
+    }
+
+    close(input[0]);
+    close(output);
+
+    const char *commands = "history\n";
+    write(input[1], commands, strlen(commands));
+    close(input[1]);
+
+    // wait for the shell to finish without reaping it so /proc/PID/io is still there
+    siginfo_t info;
+    while(waitid(P_PID, pid, &info, WEXITED | WNOWAIT) != 0 && errno == EINTR)
+        ;
+    auto stop = bench_clock::now();
+
+    long syscalls = read_write_syscalls(pid);
+    waitpid(pid, NULL, 0);
+
+    struct stat output_stat;
+    stat(OUTPUT_PATH, &output_stat);
+
+    double ms = std::chrono::duration<double, std::milli>(stop - start).count();
+    std::cout << josh << ": " << ms << " ms, " << syscalls << " write system calls, " \
+        << output_stat.st_size << " bytes written" << std::endl;
+
+    return 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+    int lines = (argc > 1) ? atoi(argv[1]) : 1000000;
+
+    if(!make_history(lines))
+    {
+        std::cerr << "could not write " << HISTORY_PATH << std::endl;
+        return 1;
+    }
+
+    std::cout << "history of " << lines << " lines" << std::endl;
+
+    if(argc <= 2)
+    {
+        run_shell("./josh");
+    }
+
+    for(int i = 2; i < argc; i++)
+    {
+        if(run_shell(argv[i]) != 0)
+            std::cerr << argv[i] << ": " << strerror(errno) << std::endl;
+    }
+
+    unlink(HISTORY_PATH);
+    unlink(OUTPUT_PATH);
+    return 0;
+}
@@ -0,0 +1,126 @@
+/*
+ * File: bench_coproc.cc
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * Measures a script that passes every record of a loop through a filter.
+ * The first script starts the filter once per record, as in
+ * 'echo record N | tr a-z A-Z >> out', and the second starts it once as a
+ * coprocess and writes every record to it with 'echo record N >&4'. Both
+ * scripts are run by the shell from a file and must produce the same
+ * output.
+ *
+ * Usage: bench_coproc [number of records] [path to josh]
+ */
+
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <chrono>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+
+#define SCRIPT_PATH "/tmp/bench_coproc_script"
+#define PER_CALL_OUTPUT "/tmp/bench_coproc_per_call"
+#define COPROC_OUTPUT "/tmp/bench_coproc_coproc"
+#define FILTER "tr a-z A-Z"
+
+
+typedef std::chrono::steady_clock bench_clock;
+
+
+static void write_script(const std::string& script)
+{
+    std::ofstream out(SCRIPT_PATH);
+    out << script;
+}
+
+
+static std::string read_file(const char *path)
+{
+    std::ifstream in(path);
+    std::stringstream contents;
+    contents << in.rdbuf();
+    return contents.str();
+}
+
+
+/*
+ * Runs the script in the shell and returns how long it took, in seconds.
+ */
+static double run_script(const char *josh)
+{
+    auto start = bench_clock::now();
+    pid_t pid = fork();
+
+    if(pid < 0)
+        return -1;
+
+    if(pid == 0)
+    {
+        int fd = open(SCRIPT_PATH, O_RDONLY);
+        dup2(fd, STDIN_FILENO);
+        close(fd);
+
+        execl(josh, josh, (char*) NULL);
+        _exit(127);
+    }
+
+    waitpid(pid, NULL, 0);
+    auto stop = bench_clock::now();
+
+    return std::chrono::duration<double>(stop - start).count();
+}
+
+
+static void report(const char *name, long records, double seconds)
+{
+    std::cout << name << ": " << seconds*1000 << " ms, " << records / seconds << " records/s" << std::endl;
+}
+
+
+int main(int argc, char *argv[])
+{
+    long records = (argc > 1) ? atol(argv[1]) : 100000;
+    const char *josh = (argc > 2) ? argv[2] : "./josh";
+
+    std::string per_call;
+    std::string coproc = std::string("coproc -w 4 ") + FILTER + " > " + COPROC_OUTPUT + "\n";
+
+    for(long i = 0; i < records; i++)
+    {
+        std::string record = "record " + std::to_string(i);
+        per_call += "echo " + record + " | " + FILTER + " >> " + PER_CALL_OUTPUT + "\n";
+        coproc += "echo " + record + " >&4\n";
+    }
+
+    // the filter sees the end of its input, and the shell waits for it to finish
+    coproc += "exec 4>&-\nwait\n";
+
+    unlink(PER_CALL_OUTPUT);
+
+    std::cout << records << " records through '" << FILTER << "'" << std::endl;
+
+    write_script(per_call);
+    double per_call_time = run_script(josh);
+
+    write_script(coproc);
+    double coproc_time = run_script(josh);
+
+    report("filter started per record", records, per_call_time);
+    report("coprocess", records, coproc_time);
+    std::cout << "speedup: " << per_call_time / coproc_time << "x" << std::endl;
+
+    if(read_file(PER_CALL_OUTPUT) != read_file(COPROC_OUTPUT))
+        std::cerr << "outputs differ" << std::endl;
+
+    unlink(SCRIPT_PATH);
+    unlink(PER_CALL_OUTPUT);
+    unlink(COPROC_OUTPUT);
+
+    return 0;
+}
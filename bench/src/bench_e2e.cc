@@ -0,0 +1,442 @@
+/*
+ * File: bench_e2e.cc
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * End-to-end benchmark of the josh binary, with dash and bash run through
+ * the same scenarios for reference. Each shell is started once and fed
+ * commands on its standard input (or on a pseudo-terminal with --pty, to
+ * take the interactive path). After every iteration the harness sends
+ * 'pwd' and waits for its output, so the time measured for an iteration
+ * is from sending its commands until all of them have finished.
+ *
+ * The scenarios are a single spawn of /bin/true, a 10-stage pipeline of
+ * cat copying a file, a command with its output redirected to a file, a
+ * flood of background jobs followed by wait, and a command with a long
+ * argument list. Each reports the p50 and p99 time per iteration and the
+ * throughput in commands (or jobs) per second or MB/s.
+ *
+ * With --load N, every shell first starts N CPU-bound background jobs, so
+ * the scenarios measure how responsive the foreground stays under load.
+ * josh is then also run with 'bgpriority -o', which shows what its
+ * background priority policy is worth.
+ *
+ * Usage: bench_e2e [--pty] [--load N] [path to josh] [iteration scale]
+ */
+
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#if defined(__APPLE__) || defined(__MACH__)
+#include <util.h>
+#else
+#include <pty.h>
+#endif
+
+
+#define READ_TIMEOUT_MS 60000
+
+// the shells run in this directory, so 'pwd' prints a line nothing else does
+#define MARKER_DIRECTORY "/tmp/bench_e2e_marker"
+
+#define SOURCE_PATH "/tmp/bench_e2e_source"
+#define SOURCE_SIZE (8*1024*1024)
+#define OUTPUT_PATH "/tmp/bench_e2e_output"
+
+#define LOAD_PATH "/tmp/bench_e2e_load"
+
+// a background load still running after this many seconds is killed;
+// --foreground keeps timeout in the shell's process group
+#define LOAD_SECONDS "600"
+
+#define PIPELINE_STAGES 10
+#define BACKGROUND_JOBS 100
+#define LONG_ARGV_ARGS 1000
+
+
+typedef std::chrono::steady_clock bench_clock;
+
+
+typedef struct
+{
+    std::string name;
+    std::vector<std::string> args;
+
+    // sent to the shell before the scenario
+    std::string setup;
+} shell_t;
+
+
+typedef struct
+{
+    pid_t pid;
+    int input;
+    int output;
+    std::string pending;
+} session_t;
+
+
+typedef struct
+{
+    std::string name;
+    std::string commands;
+    int iterations;
+
+    // what one iteration does, to report the throughput
+    double operations;
+    const char *unit;
+
+    // false if the scenario cannot be run on a terminal
+    bool on_pty;
+} scenario_t;
+
+
+
+static void write_all(int fd, const char *data, size_t length)
+{
+    while(length > 0)
+    {
+        ssize_t n = write(fd, data, length);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return;
+
+        data += n;
+        length -= n;
+    }
+}
+
+
+/*
+ * Reads the shell's output until the marker printed by 'pwd' has been
+ * seen. Returns false on timeout or end of file.
+ */
+static bool read_marker(session_t& session)
+{
+    const std::string marker = MARKER_DIRECTORY "\n";
+    const std::string pty_marker = MARKER_DIRECTORY "\r\n";
+    char buf[4096];
+
+    while(true)
+    {
+        size_t found = session.pending.find(marker);
+        size_t length = marker.size();
+
+        if(found == std::string::npos)
+        {
+            found = session.pending.find(pty_marker);
+            length = pty_marker.size();
+        }
+
+        if(found != std::string::npos)
+        {
+            session.pending.erase(0, found + length);
+            return true;
+        }
+
+        struct pollfd pfd;
+        pfd.fd = session.output;
+        pfd.events = POLLIN;
+
+        if(poll(&pfd, 1, READ_TIMEOUT_MS) <= 0)
+            return false;
+
+        ssize_t n = read(session.output, buf, sizeof(buf));
+        if(n <= 0)
+            return false;
+
+        session.pending.append(buf, n);
+
+        // only the end can still hold the start of a marker
+        if(session.pending.size() > 2*sizeof(buf))
+            session.pending.erase(0, session.pending.size() - sizeof(buf));
+    }
+}
+
+
+static bool start_session(const shell_t& shell, bool pty, session_t& session)
+{
+    std::vector<char*> args;
+    for(const std::string& arg : shell.args)
+        args.push_back((char*) arg.c_str());
+    args.push_back(NULL);
+
+    if(pty)
+    {
+        int master;
+        session.pid = forkpty(&master, NULL, NULL, NULL);
+        session.input = master;
+        session.output = master;
+    }
+    else
+    {
+        int input[2];
+        int output[2];
+        pipe(input);
+        pipe(output);
+
+        session.pid = fork();
+
+        if(session.pid == 0)
+        {
+            // so the shell and its background jobs can be killed together
+            setpgid(0, 0);
+
+            dup2(input[0], STDIN_FILENO);
+            dup2(output[1], STDOUT_FILENO);
+            close(input[0]);
+            close(input[1]);
+            close(output[0]);
+            close(output[1]);
+        }
+        else
+        {
+            close(input[0]);
+            close(output[1]);
+            session.input = input[1];
+            session.output = output[0];
+        }
+    }
+
+    if(session.pid < 0)
+        return false;
+
+    if(session.pid == 0)
+    {
+        chdir(MARKER_DIRECTORY);
+        execvp(args[0], args.data());
+        _exit(127);
+    }
+
+    // wait until the shell is reading commands
+    std::string setup = shell.setup + "pwd\n";
+    write_all(session.input, setup.data(), setup.size());
+    return read_marker(session);
+}
+
+
+static void stop_session(session_t& session)
+{
+    kill(-session.pid, SIGKILL);
+    kill(session.pid, SIGKILL);
+    waitpid(session.pid, NULL, 0);
+    close(session.input);
+    if(session.output != session.input)
+        close(session.output);
+}
+
+
+/*
+ * Runs an iteration of the scenario and returns how long it took, in
+ * microseconds, or -1 if the shell stopped responding.
+ */
+static double run_iteration(session_t& session, const std::string& commands)
+{
+    std::string input = commands + "pwd\n";
+
+    auto start = bench_clock::now();
+    write_all(session.input, input.data(), input.size());
+    if(!read_marker(session))
+        return -1;
+    auto stop = bench_clock::now();
+
+    return std::chrono::duration<double, std::micro>(stop - start).count();
+}
+
+
+static double percentile(std::vector<double>& times, double fraction)
+{
+    size_t index = (size_t) (fraction * (times.size() - 1) + 0.5);
+    return times[index];
+}
+
+
+static void run_scenario(const shell_t& shell, const scenario_t& scenario, bool pty)
+{
+    session_t session;
+    if(!start_session(shell, pty, session))
+    {
+        printf("%-8s %-12s could not start\n", shell.name.c_str(), scenario.name.c_str());
+        return;
+    }
+
+    // the first iteration pays for loading the programs, so it is not counted
+    run_iteration(session, scenario.commands);
+
+    std::vector<double> times;
+    for(int i = 0; i < scenario.iterations; i++)
+    {
+        double time = run_iteration(session, scenario.commands);
+        if(time < 0)
+            break;
+        times.push_back(time);
+    }
+
+    stop_session(session);
+
+    if(times.empty())
+    {
+        printf("%-8s %-12s timed out\n", shell.name.c_str(), scenario.name.c_str());
+        return;
+    }
+
+    double total = 0;
+    for(double time : times)
+        total += time;
+
+    std::sort(times.begin(), times.end());
+    double throughput = scenario.operations * times.size() / (total / 1e6);
+
+    printf("%-8s %-12s %10.1f %10.1f %12.1f %s\n", shell.name.c_str(), scenario.name.c_str(),
+        percentile(times, 0.5), percentile(times, 0.99), throughput, scenario.unit);
+    fflush(stdout);
+}
+
+
+static bool make_source()
+{
+    int fd = open(SOURCE_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+        return false;
+
+    std::string block(1024*1024, 'x');
+    for(size_t i = 0; i < block.size(); i += 64)
+        block[i] = '\n';
+
+    for(int i = 0; i < SOURCE_SIZE / (1024*1024); i++)
+        write_all(fd, block.data(), block.size());
+
+    close(fd);
+    return true;
+}
+
+
+static bool make_load()
+{
+    int fd = open(LOAD_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+        return false;
+
+    const char *script = "while :; do :; done\n";
+    write_all(fd, script, strlen(script));
+
+    close(fd);
+    return true;
+}
+
+
+static std::vector<scenario_t> make_scenarios(double scale, bool load)
+{
+    std::vector<scenario_t> scenarios;
+
+    scenarios.push_back({"spawn", "/bin/true\n", (int) (1000 * scale), 1, "commands/s", true});
+
+    std::string pipeline = "cat " SOURCE_PATH;
+    for(int i = 1; i < PIPELINE_STAGES; i++)
+        pipeline += " | cat";
+    pipeline += " > /dev/null\n";
+    scenarios.push_back({"pipeline10", pipeline, (int) (30 * scale), SOURCE_SIZE / 1e6, "MB/s", true});
+
+    scenarios.push_back({"redirect", "/bin/echo redirected > " OUTPUT_PATH "\n", (int) (1000 * scale), 1,
+        "commands/s", true});
+
+    // wait would also wait for the load
+    if(!load)
+    {
+        std::string flood;
+        for(int i = 0; i < BACKGROUND_JOBS; i++)
+            flood += "/bin/true &\n";
+        flood += "wait\n";
+        scenarios.push_back({"background", flood, (int) (20 * scale), BACKGROUND_JOBS, "jobs/s", true});
+    }
+
+    // longer than a terminal's line buffer, so only run on a pipe
+    std::string long_argv = "/bin/true";
+    for(int i = 0; i < LONG_ARGV_ARGS; i++)
+        long_argv += " argument_number_" + std::to_string(i);
+    long_argv += "\n";
+    scenarios.push_back({"long_argv", long_argv, (int) (500 * scale), 1, "commands/s", false});
+
+    return scenarios;
+}
+
+
+int main(int argc, char *argv[])
+{
+    bool pty = false;
+    int load = 0;
+    int first = 1;
+
+    while(argc > first)
+    {
+        if(strcmp(argv[first], "--pty") == 0)
+            pty = true;
+        else if(strcmp(argv[first], "--load") == 0 && argc > first+1)
+            load = atoi(argv[++first]);
+        else
+            break;
+
+        first++;
+    }
+
+    const char *josh = (argc > first) ? argv[first] : "./josh";
+    double scale = (argc > first+1) ? atof(argv[first+1]) : 1.0;
+
+    signal(SIGPIPE, SIG_IGN);
+    mkdir(MARKER_DIRECTORY, 0755);
+
+    if(!make_source() || !make_load())
+    {
+        std::cerr << "could not write the files in /tmp: " << strerror(errno) << std::endl;
+        return 1;
+    }
+
+    std::string setup;
+    for(int i = 0; i < load; i++)
+        setup += "timeout --foreground " LOAD_SECONDS " /bin/sh " LOAD_PATH " &\n";
+
+    std::vector<shell_t> shells;
+    shells.push_back({"josh", {josh}, setup});
+    if(load > 0)
+        shells.push_back({"josh-eq", {josh}, "bgpriority -o\n" + setup});
+    shells.push_back({"dash", pty ? std::vector<std::string>{"dash", "-i"} : std::vector<std::string>{"dash"}, setup});
+    shells.push_back({"bash", pty ? std::vector<std::string>{"bash", "--norc", "--noprofile", "-i"} : \
+        std::vector<std::string>{"bash", "--norc", "--noprofile"}, setup});
+
+    printf("%s, times per iteration in microseconds", pty ? "pseudo-terminal" : "pipe");
+    if(load > 0)
+        printf(", %d background jobs of load", load);
+    printf("\n");
+    printf("%-8s %-12s %10s %10s %12s\n", "shell", "scenario", "p50", "p99", "throughput");
+
+    for(const scenario_t& scenario : make_scenarios(scale, load > 0))
+    {
+        if(pty && !scenario.on_pty)
+            continue;
+
+        for(const shell_t& shell : shells)
+            run_scenario(shell, scenario, pty);
+    }
+
+    unlink(SOURCE_PATH);
+    unlink(OUTPUT_PATH);
+    unlink(LOAD_PATH);
+    rmdir(MARKER_DIRECTORY);
+
+    return 0;
+}
@@ -0,0 +1,193 @@
+/*
+ * File: bench_fork_server.cc
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * Measures how long the shell takes to start a command as it grows. The
+ * shell's heap is grown by defining aliases with long values until its
+ * resident set reaches each size, and then it runs /bin/true many times.
+ * Every size is measured with the shell forking the commands itself and
+ * with --fork-server.
+ *
+ * Usage: bench_fork_server [commands per size] [path to josh]
+ */
+
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+
+
+#define ALIAS_LENGTH 4000
+#define ALIASES_PER_BATCH 256
+
+
+typedef std::chrono::steady_clock bench_clock;
+
+
+typedef struct
+{
+    pid_t pid;
+    int input;
+    int output;
+} shell_t;
+
+
+static shell_t start_shell(const char *josh, bool fork_server)
+{
+    int input[2];
+    int output[2];
+    pipe(input);
+    pipe(output);
+
+    shell_t shell;
+    shell.pid = fork();
+
+    if(shell.pid == 0)
+    {
+        dup2(input[0], STDIN_FILENO);
+        dup2(output[1], STDOUT_FILENO);
+        close(input[0]);
+        close(input[1]);
+        close(output[0]);
+        close(output[1]);
+
+        if(fork_server)
+            execl(josh, josh, "--fork-server", (char*) NULL);
+        else
+            execl(josh, josh, (char*) NULL);
+        _exit(127);
+    }
+
+    close(input[0]);
+    close(output[1]);
+    shell.input = input[1];
+    shell.output = output[0];
+
+    return shell;
+}
+
+
+static void send(shell_t& shell, const std::string& commands)
+{
+    size_t sent = 0;
+    while(sent < commands.size())
+    {
+        ssize_t written = write(shell.input, commands.data() + sent, commands.size() - sent);
+        if(written <= 0)
+            return;
+        sent += written;
+    }
+}
+
+
+/*
+ * Runs pwd in the shell and waits for its output, so everything sent
+ * before it has been run.
+ */
+static void sync_with(shell_t& shell)
+{
+    send(shell, "pwd\n");
+
+    char c;
+    while(read(shell.output, &c, 1) == 1 && c != '\n')
+        ;
+}
+
+
+static long resident_kib(pid_t pid)
+{
+    std::string path = "/proc/" + std::to_string(pid) + "/status";
+    FILE *status = fopen(path.c_str(), "r");
+    if(status == NULL)
+        return -1;
+
+    char line[256];
+    long kib = -1;
+    while(fgets(line, sizeof(line), status) != NULL)
+    {
+        if(strncmp(line, "VmRSS:", 6) == 0)
+            kib = atol(line + 6);
+    }
+
+    fclose(status);
+    return kib;
+}
+
+
+/*
+ * Defines aliases until the shell's resident set is at least the given size.
+ */
+static void grow(shell_t& shell, long mebibytes, long& next_alias)
+{
+    std::string value(ALIAS_LENGTH, 'x');
+
+    while(resident_kib(shell.pid) < mebibytes * 1024)
+    {
+        std::string batch;
+        for(int i = 0; i < ALIASES_PER_BATCH; i++)
+            batch += "alias grow" + std::to_string(next_alias++) + "=" + value + "\n";
+
+        send(shell, batch);
+        sync_with(shell);
+    }
+}
+
+
+/*
+ * Returns the average time to run /bin/true, in microseconds.
+ */
+static double spawn_latency(shell_t& shell, int commands)
+{
+    std::string batch;
+    for(int i = 0; i < commands; i++)
+        batch += "/bin/true\n";
+
+    auto start = bench_clock::now();
+    send(shell, batch);
+    sync_with(shell);
+    auto stop = bench_clock::now();
+
+    return std::chrono::duration<double, std::micro>(stop - start).count() / commands;
+}
+
+
+int main(int argc, char *argv[])
+{
+    int commands = (argc > 1) ? atoi(argv[1]) : 2000;
+    const char *josh = (argc > 2) ? argv[2] : "./josh";
+
+    std::vector<long> sizes = {0, 64, 256, 1024};
+
+    std::cout << "RSS (MiB)   fork (us)   fork server (us)" << std::endl;
+
+    shell_t forking = start_shell(josh, false);
+    shell_t served = start_shell(josh, true);
+    long forking_aliases = 0;
+    long served_aliases = 0;
+
+    for(long size : sizes)
+    {
+        grow(forking, size, forking_aliases);
+        grow(served, size, served_aliases);
+
+        double fork_time = spawn_latency(forking, commands);
+        double server_time = spawn_latency(served, commands);
+
+        printf("%9ld   %9.1f   %16.1f\n", resident_kib(forking.pid) / 1024, fork_time, server_time);
+        fflush(stdout);
+    }
+
+    close(forking.input);
+    close(served.input);
+    waitpid(forking.pid, NULL, 0);
+    waitpid(served.pid, NULL, 0);
+
+    return 0;
+}
@@ -0,0 +1,229 @@
+/*
+ * File: bench_keystroke_latency.cc
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * Measures the keystroke-to-echo latency of the line editor. The shell is
+ * started on a pseudo-terminal, and for each key the time from writing it
+ * to the master side until its echo is read back is recorded. A large
+ * paste is also timed to check that redraw cost stays linear in its size.
+ *
+ * Usage: bench_keystroke_latency [path to josh] [number of keystrokes]
+ */
+
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#if defined(__APPLE__) || defined(__MACH__)
+#include <util.h>
+#else
+#include <pty.h>
+#endif
+
+
+#define READ_TIMEOUT_MS 5000
+#define PASTE_SIZE (256*1024)
+
+
+typedef std::chrono::steady_clock bench_clock;
+
+
+/*
+ * Reads from the master side until the expected text has been seen.
+ * Returns false on timeout or end of file.
+ */
+static bool read_until(int master, const std::string& expected)
+{
+    static std::string pending;
+    char buf[4096];
+
+    while(pending.find(expected) == std::string::npos)
+    {
+        struct pollfd pfd;
+        pfd.fd = master;
+        pfd.events = POLLIN;
+
+        if(poll(&pfd, 1, READ_TIMEOUT_MS) <= 0)
+            return false;
+
+        ssize_t n = read(master, buf, sizeof(buf));
+        if(n <= 0)
+            return false;
+
+        pending.append(buf, n);
+    }
+
+    pending.erase(0, pending.find(expected) + expected.size());
+    return true;
+}
+
+
+static void write_all(int fd, const char *data, size_t length)
+{
+    while(length > 0)
+    {
+        ssize_t n = write(fd, data, length);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return;
+        data += n;
+        length -= n;
+    }
+}
+
+
+/*
+ * Writes a large paste while draining the echo at the same time. The
+ * pseudo-terminal buffers are far smaller than the paste, so writing it
+ * all first would deadlock with the shell blocked on echoing it.
+ */
+static bool paste_and_wait(int master, const std::string& paste, const std::string& marker)
+{
+    std::string echoed;
+    size_t written = 0;
+    char buf[4096];
+
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+    while(echoed.find(marker) == std::string::npos)
+    {
+        struct pollfd pfd;
+        pfd.fd = master;
+        pfd.events = POLLIN | (written < paste.size() ? POLLOUT : 0);
+
+        if(poll(&pfd, 1, READ_TIMEOUT_MS) <= 0)
+            return false;
+
+        if(pfd.revents & POLLIN)
+        {
+            ssize_t n = read(master, buf, sizeof(buf));
+            if(n <= 0 && errno != EAGAIN)
+                return false;
+
+            // only keep enough of the tail to find the marker
+            if(n > 0)
+                echoed.append(buf, n);
+            if(echoed.size() > sizeof(buf))
+                echoed.erase(0, echoed.size() - marker.size());
+        }
+
+        if((pfd.revents & POLLOUT) && written < paste.size())
+        {
+            size_t chunk = std::min(paste.size() - written, sizeof(buf));
+            ssize_t n = write(master, paste.data() + written, chunk);
+            if(n > 0)
+                written += n;
+        }
+    }
+
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) & ~O_NONBLOCK);
+    return true;
+}
+
+
+static double percentile(std::vector<double>& samples, double p)
+{
+    size_t index = (size_t) (p * (samples.size() - 1));
+    return samples[index];
+}
+
+
+int main(int argc, char *argv[])
+{
+    const char *josh = (argc > 1) ? argv[1] : "./josh";
+    int keystrokes = (argc > 2) ? atoi(argv[2]) : 10000;
+
+    int master;
+    pid_t pid = forkpty(&master, NULL, NULL, NULL);
+
+    if(pid < 0)
+    {
+        std::cerr << "forkpty: " << strerror(errno) << std::endl;
+        return 1;
+    }
+
+    if(pid == 0)
+    {
+        execl(josh, josh, (char*) NULL);
+        _exit(127);
+    }
+
+    if(!read_until(master, "% "))
+    {
+        std::cerr << "no prompt from " << josh << std::endl;
+        return 1;
+    }
+
+    // single keystrokes, clearing the line now and then to keep it short
+    std::vector<double> latencies;
+    for(int i = 0; i < keystrokes; i++)
+    {
+        char key = 'a' + (i % 26);
+        std::string echo(1, key);
+
+        auto start = bench_clock::now();
+        write_all(master, &key, 1);
+        if(!read_until(master, echo))
+        {
+            std::cerr << "timed out waiting for echo" << std::endl;
+            return 1;
+        }
+        auto stop = bench_clock::now();
+
+        latencies.push_back(std::chrono::duration<double, std::micro>(stop - start).count());
+
+        if(i % 64 == 63)
+        {
+            char kill_line = 0x15;
+            write_all(master, &kill_line, 1);
+            read_until(master, "\x1b[K");
+        }
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << "keystrokes: " << keystrokes << std::endl;
+    std::cout << "echo latency p50: " << percentile(latencies, 0.50) << " us" << std::endl;
+    std::cout << "echo latency p99: " << percentile(latencies, 0.99) << " us" << std::endl;
+    std::cout << "echo latency max: " << latencies.back() << " us" << std::endl;
+
+    // one large paste ending in a marker so we know when all of it is echoed
+    char kill_line = 0x15;
+    write_all(master, &kill_line, 1);
+    read_until(master, "\x1b[K");
+
+    std::string paste(PASTE_SIZE, 'x');
+    paste += "END";
+
+    auto start = bench_clock::now();
+    if(!paste_and_wait(master, paste, "END"))
+    {
+        std::cerr << "timed out waiting for paste echo" << std::endl;
+        return 1;
+    }
+    auto stop = bench_clock::now();
+
+    double paste_ms = std::chrono::duration<double, std::milli>(stop - start).count();
+    std::cout << "paste of " << paste.size() << " bytes echoed in " << paste_ms << " ms" << std::endl;
+
+    write_all(master, &kill_line, 1);
+    write_all(master, "exit\r", 5);
+
+    int status;
+    waitpid(pid, &status, 0);
+    close(master);
+
+    return 0;
+}
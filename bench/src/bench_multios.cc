@@ -0,0 +1,161 @@
+/*
+ * File: bench_multios.cc
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * Measures the throughput of writing a command's output to several files.
+ * The shell runs 'cat SOURCE > a > b > c', where its relay copies the data
+ * with tee and splice, and then 'cat SOURCE | tee a b > c' with the tee
+ * program, which reads every byte into user space and writes it out once
+ * per file. The source file is read once beforehand so both runs read it
+ * from the page cache.
+ *
+ * Usage: bench_multios [size in MiB] [number of files] [path to josh] [path to tee]
+ */
+
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+
+#define SOURCE_PATH "/tmp/bench_multios_source"
+#define TARGET_PREFIX "/tmp/bench_multios_out"
+#define RUNS 5
+
+
+typedef std::chrono::steady_clock bench_clock;
+
+
+static bool make_source(long mebibytes)
+{
+    int fd = open(SOURCE_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+        return false;
+
+    std::string block(1024*1024, 'x');
+    for(long i = 0; i < mebibytes; i++)
+    {
+        block[i % block.size()] = '\n';
+        if(write(fd, block.data(), block.size()) != (ssize_t) block.size())
+        {
+            close(fd);
+            return false;
+        }
+    }
+
+    close(fd);
+
+    // read it back once so every run reads it from the page cache
+    fd = open(SOURCE_PATH, O_RDONLY);
+    while(read(fd, &block[0], block.size()) > 0)
+        ;
+    close(fd);
+
+    return true;
+}
+
+
+/*
+ * Runs a single command in the shell and returns how long the shell took
+ * to run it, in seconds.
+ */
+static double run_command(const char *josh, const std::string& command)
+{
+    int input[2];
+    if(pipe(input) != 0)
+        return -1;
+
+    auto start = bench_clock::now();
+    pid_t pid = fork();
+
+    if(pid < 0)
+        return -1;
+
+    if(pid == 0)
+    {
+        dup2(input[0], STDIN_FILENO);
+        close(input[0]);
+        close(input[1]);
+
+        execl(josh, josh, (char*) NULL);
+        _exit(127);
+    }
+
+    close(input[0]);
+
+    std::string line = command + "\n";
+    write(input[1], line.data(), line.size());
+    close(input[1]);
+
+    waitpid(pid, NULL, 0);
+    auto stop = bench_clock::now();
+
+    return std::chrono::duration<double>(stop - start).count();
+}
+
+
+static void report(const char *name, long mebibytes, int files, std::vector<double>& times)
+{
+    double best = times[0];
+    for(double time : times)
+    {
+        if(time < best)
+            best = time;
+    }
+
+    std::cout << name << ": best of " << times.size() << " " << best*1000 << " ms, " \
+        << mebibytes / best << " MiB/s in, " << mebibytes * files / best << " MiB/s out" << std::endl;
+}
+
+
+int main(int argc, char *argv[])
+{
+    long mebibytes = (argc > 1) ? atol(argv[1]) : 64;
+    int files = (argc > 2) ? atoi(argv[2]) : 3;
+    const char *josh = (argc > 3) ? argv[3] : "./josh";
+    const char *tee = (argc > 4) ? argv[4] : "/usr/bin/tee";
+
+    if(!make_source(mebibytes))
+    {
+        std::cerr << "could not write " << SOURCE_PATH << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+
+    std::string multios = std::string("cat ") + SOURCE_PATH;
+    std::string piped = std::string("cat ") + SOURCE_PATH + " | " + tee;
+
+    for(int i = 0; i < files; i++)
+    {
+        std::string target = TARGET_PREFIX + std::to_string(i);
+        multios += " > " + target;
+        piped += (i == files-1 ? " > " : " ") + target;
+    }
+
+    std::cout << mebibytes << " MiB to " << files << " files" << std::endl;
+
+    std::vector<double> multios_times;
+    std::vector<double> piped_times;
+
+    for(int run = 0; run < RUNS; run++)
+    {
+        multios_times.push_back(run_command(josh, multios));
+        piped_times.push_back(run_command(josh, piped));
+    }
+
+    report("josh multios", mebibytes, files, multios_times);
+    report(tee, mebibytes, files, piped_times);
+
+    unlink(SOURCE_PATH);
+    for(int i = 0; i < files; i++)
+        unlink((TARGET_PREFIX + std::to_string(i)).c_str());
+
+    return 0;
+}
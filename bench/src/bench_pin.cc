@@ -0,0 +1,147 @@
+/*
+ * File: bench_pin.cc
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * Measures the throughput of a pipeline of cat copying a file, with the
+ * stages left to the scheduler, spread over adjacent CPUs with 'pin -s',
+ * and all pinned to the shell's first CPU. Each placement is run several
+ * times, alternating between them, and the best run is reported, since
+ * other load on the machine only makes a run slower.
+ *
+ * Usage: bench_pin [path to josh] [stages] [runs]
+ */
+
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+
+
+#define SOURCE_PATH "/tmp/bench_pin_source"
+#define SOURCE_SIZE (64*1024*1024)
+
+// pipelines per run
+#define PIPELINES 8
+
+
+typedef std::chrono::steady_clock bench_clock;
+
+
+typedef struct
+{
+    const char *name;
+    const char *setting;
+    double best;
+} placement_run_t;
+
+
+static bool make_source()
+{
+    int fd = open(SOURCE_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+        return false;
+
+    std::string block(1024*1024, 'x');
+    for(size_t i = 0; i < block.size(); i += 64)
+        block[i] = '\n';
+
+    for(int i = 0; i < SOURCE_SIZE / (1024*1024); i++)
+    {
+        if(write(fd, block.data(), block.size()) != (ssize_t) block.size())
+        {
+            close(fd);
+            return false;
+        }
+    }
+
+    close(fd);
+    return true;
+}
+
+
+/*
+ * Runs the script in a new shell and returns how long it took, in seconds.
+ */
+static double run_shell(const char *josh, const std::string& script)
+{
+    int input[2];
+    pipe(input);
+
+    auto start = bench_clock::now();
+    pid_t pid = fork();
+
+    if(pid == 0)
+    {
+        dup2(input[0], STDIN_FILENO);
+        close(input[0]);
+        close(input[1]);
+        execl(josh, josh, (char*) NULL);
+        _exit(127);
+    }
+
+    close(input[0]);
+    write(input[1], script.data(), script.size());
+    close(input[1]);
+
+    waitpid(pid, NULL, 0);
+    auto stop = bench_clock::now();
+
+    return std::chrono::duration<double>(stop - start).count();
+}
+
+
+int main(int argc, char *argv[])
+{
+    const char *josh = (argc > 1) ? argv[1] : "./josh";
+    int stages = (argc > 2) ? atoi(argv[2]) : 4;
+    int runs = (argc > 3) ? atoi(argv[3]) : 5;
+
+    if(!make_source())
+    {
+        std::cerr << "could not write " << SOURCE_PATH << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+
+    std::string pipeline = "cat " SOURCE_PATH;
+    for(int i = 1; i < stages; i++)
+        pipeline += " | cat";
+    pipeline += " > /dev/null\n";
+
+    std::vector<placement_run_t> placements = {
+        {"unpinned", "pin -o\n", 0},
+        {"spread", "pin -s\n", 0},
+        {"one cpu", "pin -c 0\n", 0}
+    };
+
+    for(int run = 0; run < runs; run++)
+    {
+        for(placement_run_t& placement : placements)
+        {
+            std::string script = placement.setting;
+            for(int i = 0; i < PIPELINES; i++)
+                script += pipeline;
+
+            double seconds = run_shell(josh, script);
+            if(placement.best == 0 || seconds < placement.best)
+                placement.best = seconds;
+        }
+    }
+
+    printf("%d-stage pipeline, %d MiB per pipeline, best of %d runs\n", stages, SOURCE_SIZE / (1024*1024), runs);
+    for(placement_run_t& placement : placements)
+    {
+        printf("%-10s %8.1f MB/s\n", placement.name, PIPELINES * (SOURCE_SIZE / 1e6) / placement.best);
+    }
+
+    unlink(SOURCE_PATH);
+    return 0;
+}
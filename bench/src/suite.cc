@@ -0,0 +1,251 @@
+/*
+ * File: suite.cc
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * Microbenchmarks for the parts of the shell that run on every command:
+ * tokenizing and parsing a line, the tables, building the arguments for
+ * exec, and rendering the prompt. Built optimized and run by 'make bench',
+ * which writes the results as JSON. 'make bench-compare' compares them
+ * with the committed baseline.
+ *
+ * Each benchmark is timed in BENCH_SAMPLES samples of enough iterations to
+ * take at least BENCH_SAMPLE_NS. The fastest, median, and slowest samples
+ * are reported. The fastest is the one least disturbed by the rest of the
+ * machine, so it is the one compared with the baseline.
+ *
+ * Usage: suite [name filter]
+ */
+
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#include <hashtable.h>
+#include <job.h>
+#include <parse.h>
+#include <prompt.h>
+
+
+#define BENCH_SAMPLES 31
+#define BENCH_SAMPLE_NS 10000000L
+
+// the command line used by the parsing benchmarks
+#define BENCH_LINE "ls -l /usr/bin /usr/local/bin | grep -v tmp | sort -r > listing.txt 2> errors.txt"
+#define BENCH_LIST_LINE "make -j8 && ./run --all > out.txt || cat errors.txt ; echo done"
+
+// number of keys in the table benchmarks, about the size of a large alias table
+#define BENCH_TABLE_KEYS 1000
+
+
+typedef std::chrono::steady_clock bench_clock;
+
+
+/*
+ * Written by every benchmark so the compiler cannot drop the work.
+ */
+static volatile size_t sink;
+
+
+typedef struct
+{
+    const char *name;
+    const char *unit;
+    long iterations;
+    double median_ns;
+    double min_ns;
+    double max_ns;
+} result_t;
+
+
+/*
+ * Times body, where each call does ops_per_call operations. The results
+ * are per operation.
+ */
+template <typename F>
+static result_t measure(const char *name, const char *unit, long ops_per_call, F body)
+{
+    // find how many calls make a sample long enough to time
+    long calls = 1;
+    while(true)
+    {
+        auto start = bench_clock::now();
+        for(long i = 0; i < calls; i++)
+            body();
+        auto stop = bench_clock::now();
+
+        if(std::chrono::duration<double, std::nano>(stop - start).count() >= BENCH_SAMPLE_NS)
+            break;
+        calls *= 2;
+    }
+
+    std::vector<double> samples;
+    for(int sample = 0; sample < BENCH_SAMPLES; sample++)
+    {
+        auto start = bench_clock::now();
+        for(long i = 0; i < calls; i++)
+            body();
+        auto stop = bench_clock::now();
+
+        samples.push_back(std::chrono::duration<double, std::nano>(stop - start).count() / (calls * ops_per_call));
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    result_t result;
+    result.name = name;
+    result.unit = unit;
+    result.iterations = calls * ops_per_call;
+    result.median_ns = samples[samples.size() / 2];
+    result.min_ns = samples.front();
+    result.max_ns = samples.back();
+
+    return result;
+}
+
+
+
+/**************
+ * Benchmarks *
+ **************/
+
+static std::vector<std::string> table_keys()
+{
+    std::vector<std::string> keys;
+    for(int i = 0; i < BENCH_TABLE_KEYS; i++)
+        keys.push_back("alias_name_" + std::to_string(i));
+
+    return keys;
+}
+
+
+static void run_benchmarks(std::vector<result_t>& results, const char *filter)
+{
+    std::string line = BENCH_LINE;
+    std::string delimiters = " ";
+
+    std::vector<std::string> tokens = tokenize(line, delimiters);
+    std::vector<std::string> list_tokens = tokenize(std::string(BENCH_LIST_LINE), delimiters);
+    std::vector<std::string> command_tokens(tokens.begin(), std::find(tokens.begin(), tokens.end(), "|"));
+    std::vector<std::string> keys = table_keys();
+
+    // built here so that table_miss times the lookups and not the strings
+    std::vector<std::string> missing_keys;
+    for(std::string& key : keys)
+        missing_keys.push_back(key + "x");
+
+    Table<std::string, std::string> full_table;
+    for(std::string& key : keys)
+        full_table.insert(key, key);
+
+    Command command = parse_command(command_tokens);
+    char *args[MAX_COMMAND_TOKENS+1];
+
+    auto run = [&](const char *name, const char *unit, long ops_per_call, std::function<void()> body)
+    {
+        if(filter == NULL || strstr(name, filter) != NULL)
+            results.push_back(measure(name, unit, ops_per_call, body));
+    };
+
+    run("tokenize", "line", 1, [&]()
+    {
+        sink += tokenize(line, delimiters).size();
+    });
+
+    run("getJob", "line", 1, [&]()
+    {
+        sink += getJob(line).getNumCommands();
+    });
+
+    run("parse_job", "line", 1, [&]()
+    {
+        sink += parse_job(tokens).getNumCommands();
+    });
+
+    run("parse_list", "line", 1, [&]()
+    {
+        sink += parse_list(list_tokens).getNumJobs();
+    });
+
+    run("parse_command", "command", 1, [&]()
+    {
+        sink += parse_command(command_tokens).getNumTokens();
+    });
+
+    run("table_insert", "key", BENCH_TABLE_KEYS, [&]()
+    {
+        Table<std::string, std::string> table;
+        for(std::string& key : keys)
+            table.insert(key, key);
+        sink += table.contains(keys[0]);
+    });
+
+    run("table_lookup", "key", BENCH_TABLE_KEYS, [&]()
+    {
+        for(std::string& key : keys)
+            sink += full_table.get(key).size();
+    });
+
+    run("table_miss", "key", BENCH_TABLE_KEYS, [&]()
+    {
+        for(std::string& key : missing_keys)
+            sink += full_table.contains(key);
+    });
+
+    run("make_args", "command", 1, [&]()
+    {
+        make_args(command, args, command.getNumTokens());
+        sink += (size_t) args[0];
+    });
+
+    if(initialize_prompt() != 0)
+        return;
+
+    run("make_prompt", "prompt", 1, [&]()
+    {
+        sink += make_prompt().size();
+    });
+
+    run("make_prompt_after_cd", "prompt", 1, [&]()
+    {
+        update_prompt_directory();
+        sink += make_prompt().size();
+    });
+}
+
+
+static void print_json(std::vector<result_t>& results)
+{
+    printf("{\n  \"benchmarks\": [\n");
+
+    for(size_t i = 0; i < results.size(); i++)
+    {
+        result_t& result = results[i];
+        printf("    {\"name\": \"%s\", \"unit\": \"%s\", \"iterations\": %ld, "
+            "\"median_ns\": %.1f, \"min_ns\": %.1f, \"max_ns\": %.1f}%s\n",
+            result.name, result.unit, result.iterations, result.median_ns, result.min_ns, result.max_ns,
+            (i+1 < results.size()) ? "," : "");
+    }
+
+    printf("  ]\n}\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+    // the default prompt, without the version control segment and its worker
+    unsetenv("PS1");
+
+    std::vector<result_t> results;
+    run_benchmarks(results, (argc > 1) ? argv[1] : NULL);
+    print_json(results);
+
+    return 0;
+}
@@ -0,0 +1,81 @@
+/* File: affinity.h
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * This header defines the placement of commands on CPUs and NUMA nodes,
+ * set with 'pin'. Followed by a command, pin is a prefix that places only
+ * that command (or stage of a pipeline). Without one it is a builtin that
+ * sets the placement of every command the shell starts from then on.
+ *
+ *     pin -c 4-7 make          run make on CPUs 4 to 7
+ *     pin -m 1 sort big.txt    allocate sort's memory only on node 1
+ *     pin -s                   spread the stages of every pipeline
+ *     pin -o                   stop placing commands
+ *
+ * With -s, the stages of a pipeline run on adjacent CPUs of one node,
+ * starting at the CPU the shell is running on, and prefer that node's
+ * memory, so the data passed between them stays in one socket's caches.
+ *
+ * The placement is applied in each child between fork and exec, with
+ * sched_setaffinity and set_mempolicy. It is only available on Linux.
+ */
+
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <string>
+#include <vector>
+
+
+typedef struct
+{
+    bool spread;
+    std::vector<int> cpus;
+    std::vector<int> nodes;
+} placement_t;
+
+
+/*
+ * Parses pin's options starting at tokens[first] into placement. Returns
+ * the index of the first token after them, or -1 (having printed why) if
+ * they are not valid. With off, -o is accepted and clears the placement.
+ */
+int parse_placement_arguments(const std::vector<std::string>& tokens, size_t first, bool off, placement_t& placement);
+
+/*
+ * Checks if pin's options in tokens (starting with 'pin') are followed by
+ * a command, which makes it a prefix rather than the builtin.
+ */
+bool placement_has_command(const std::vector<std::string>& tokens);
+
+/*
+ * Returns true if the placement does nothing.
+ */
+bool placement_is_empty(const placement_t& placement);
+
+/*
+ * The placement of every command without a pin prefix, set by the pin
+ * builtin.
+ */
+placement_t& default_placement();
+
+/*
+ * Prints a placement as the options that set it.
+ */
+void print_placement(const placement_t& placement);
+
+/*
+ * Called by the shell before it forks the stages of a job: chooses the
+ * CPUs that spread stages run on, starting from the one the shell is on,
+ * so that every stage of the job sees the same choice.
+ */
+void plan_spread();
+
+/*
+ * Applies a placement to the current process, which is the given stage
+ * of its pipeline. Returns -1 (having printed why) if it cannot be
+ * applied.
+ */
+int apply_placement(const placement_t& placement, int stage);
+
+
+#endif
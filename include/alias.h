@@ -0,0 +1,51 @@
+/* File: alias.h
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * This header defines the functions for defining aliases and expanding
+ * them in the token stream of a command line before it is parsed.
+ */
+
+#ifndef ALIAS_H
+#define ALIAS_H
+
+#include <string>
+#include <vector>
+
+
+/*
+ * Defines (or redefines) an alias. Invalidates all memoized expansions
+ * since any of them may refer to this alias. Redefining an alias with the
+ * value it already has changes nothing.
+ */
+void set_alias(std::string name, std::string value);
+
+/*
+ * Removes an alias. Returns false if there was no such alias.
+ */
+bool remove_alias(std::string name);
+
+/*
+ * Removes every alias.
+ */
+void remove_all_aliases();
+
+/*
+ * Expands the first word of every command in the token sequence if it is
+ * an alias. If the value of an alias ends with a blank, the word following
+ * it is also checked for an alias. An alias is never expanded inside its
+ * own expansion, so 'alias ls=ls -F' does not recurse.
+ *
+ * The fully expanded token sequence of each alias is memoized, so
+ * expanding a heavily aliased command line is a table lookup per word.
+ */
+std::vector<std::string> expand_aliases(const std::vector<std::string>& tokens);
+
+/*
+ * Returns a counter that changes whenever an alias is defined, redefined,
+ * or removed, so that a command parsed earlier can be reused only while
+ * it is the same.
+ */
+unsigned long get_alias_generation();
+
+
+#endif
@@ -25,16 +25,21 @@ typedef int (*builtin_t)(int argc, std::string argv[]);
 // the following functions execute Bourne shell (sh) specific builtins
 BUILTIN_TABLE int do_builtin_cd(int argc, std::string argv[]);
 BUILTIN_TABLE int do_builtin_dot(int argc, std::string argv[]);
+BUILTIN_TABLE int do_builtin_exec(int argc, std::string argv[]);
 BUILTIN_TABLE int do_builtin_exit(int argc, std::string argv[]);
 BUILTIN_TABLE int do_builtin_export(int argc, std::string argv[]);
 BUILTIN_TABLE int do_builtin_pwd(int argc, std::string argv[]);
+BUILTIN_TABLE int do_builtin_ulimit(int argc, std::string argv[]);
 BUILTIN_TABLE int do_builtin_umask(int argc, std::string argv[]);
 BUILTIN_TABLE int do_builtin_unset(int argc, std::string argv[]);
+BUILTIN_TABLE int do_builtin_wait(int argc, std::string argv[]);
 
 
 // the following functions execute Bourne again shell (bash) specific builtins
 BUILTIN_TABLE int do_builtin_alias(int argc, std::string argv[]);
 BUILTIN_TABLE int do_builtin_echo(int argc, std::string argv[]);
+BUILTIN_TABLE int do_builtin_enable(int argc, std::string argv[]);
+BUILTIN_TABLE int do_builtin_history(int argc, std::string argv[]);
 BUILTIN_TABLE int do_builtin_kill(int argc, std::string argv[]);
 BUILTIN_TABLE int do_builtin_source(int argc, std::string argv[]);
 BUILTIN_TABLE int do_builtin_unalias(int argc, std::string argv[]);
@@ -46,4 +51,10 @@ BUILTIN_TABLE int do_builtin_fg(int argc, std::string argv[]);
 BUILTIN_TABLE int do_builtin_jobs(int argc, std::string argv[]);
 
 
+// builtins specific to this shell
+BUILTIN_TABLE int do_builtin_bgpriority(int argc, std::string argv[]);
+BUILTIN_TABLE int do_builtin_pin(int argc, std::string argv[]);
+BUILTIN_TABLE int do_builtin_stats(int argc, std::string argv[]);
+
+
 #endif
\ No newline at end of file
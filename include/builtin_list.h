@@ -4,10 +4,10 @@
 
 #include <builtin.h>
 
-const builtin_t builtin_list[] = {do_builtin_cd, do_builtin_dot, do_builtin_exit, do_builtin_export, do_builtin_pwd, do_builtin_umask, do_builtin_unset, do_builtin_alias, do_builtin_echo, do_builtin_kill, do_builtin_source, do_builtin_unalias, do_builtin_bg, do_builtin_fg, do_builtin_jobs};
+const builtin_t builtin_list[] = {do_builtin_cd, do_builtin_dot, do_builtin_exec, do_builtin_exit, do_builtin_export, do_builtin_pwd, do_builtin_ulimit, do_builtin_umask, do_builtin_unset, do_builtin_wait, do_builtin_alias, do_builtin_echo, do_builtin_enable, do_builtin_history, do_builtin_kill, do_builtin_source, do_builtin_unalias, do_builtin_bg, do_builtin_fg, do_builtin_jobs, do_builtin_bgpriority, do_builtin_pin, do_builtin_stats};
 
-const char *builtin_commands_list[] = {"cd", "dot", "exit", "export", "pwd", "umask", "unset", "alias", "echo", "kill", "source", "unalias", "bg", "fg", "jobs"};
+const char *builtin_commands_list[] = {"cd", "dot", "exec", "exit", "export", "pwd", "ulimit", "umask", "unset", "wait", "alias", "echo", "enable", "history", "kill", "source", "unalias", "bg", "fg", "jobs", "bgpriority", "pin", "stats"};
 
-int num_builtins = 15;
+int num_builtins = 23;
 
 #endif
\ No newline at end of file
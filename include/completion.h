@@ -0,0 +1,42 @@
+/* File: completion.h
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * This header defines tab completion for the line editor. Command names
+ * come from an index of the executables on the PATH that is built on a
+ * background thread at startup and then kept up to date with inotify, so
+ * completing a command never rescans the PATH. File names come from a
+ * cache of directory listings that is refreshed when a directory's
+ * modification time changes.
+ */
+
+#ifndef COMPLETION_H
+#define COMPLETION_H
+
+#include <string>
+#include <vector>
+
+
+/*
+ * Starts the background thread that builds the PATH command index. Until
+ * the first scan is done, commands are completed from the builtins and
+ * aliases only, so the first Tab never waits on the scan.
+ */
+void start_command_index();
+
+/*
+ * Asks the background thread to rebuild the command index, e.g. after
+ * PATH has been changed or unset. Must be called from the main thread,
+ * which hands the thread a copy of PATH. Does nothing if the index was
+ * never started.
+ */
+void rebuild_command_index();
+
+/*
+ * Completion function for the line editor. Returns the possible
+ * completions of the word ending at the cursor and sets word_start to the
+ * offset in line where that word begins. Directories end with a '/'.
+ */
+std::vector<std::string> complete_word(const std::string& line, size_t cursor, size_t& word_start);
+
+
+#endif
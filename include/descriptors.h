@@ -0,0 +1,46 @@
+/* File: descriptors.h
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * This header defines how the shell shares file descriptors with the
+ * user. Descriptors 0 to 9 belong to the user: they are the ones that
+ * 'exec 3> file' and '>&3' refer to, and commands inherit them. Every
+ * descriptor the shell keeps open for itself (the history file, the
+ * completion index, descriptors saved while a builtin is redirected) is
+ * moved to 10 or above and marked close-on-exec, so the two never collide
+ * and commands never see the shell's own files.
+ */
+
+#ifndef DESCRIPTORS_H
+#define DESCRIPTORS_H
+
+
+// descriptors below this belong to the user, as in sh
+#define USER_FD_LIMIT 10
+
+
+/*
+ * Moves a descriptor the shell keeps open for itself out of the user's
+ * range and marks it close-on-exec. Returns the new descriptor, or the
+ * old one if it could not be moved.
+ */
+int move_to_shell_fd(int fd);
+
+/*
+ * Saves a copy of a descriptor that is about to be redirected, so that it
+ * can be put back afterwards. Returns -1 if fd is not open.
+ */
+int save_fd(int fd);
+
+/*
+ * Puts back a descriptor saved by save_fd. If it was not open before, it
+ * is closed.
+ */
+void restore_fd(int fd, int saved);
+
+/*
+ * Returns true if fd is open.
+ */
+bool is_fd_open(int fd);
+
+
+#endif
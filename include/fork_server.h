@@ -0,0 +1,49 @@
+/* File: fork_server.h
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * This header defines the optional fork server, started with
+ * --fork-server. Forking copies the page tables of the whole shell, so the
+ * cost of starting a command grows with everything the shell has
+ * allocated (history, aliases, the completion index). The fork server is
+ * a small process forked at startup, before any of that is allocated. The
+ * shell sends it the arguments, the environment, the working directory,
+ * the umask, and the descriptors of each command over a socket, and it
+ * starts the command, so the cost stays the same however large the shell
+ * grows. Once the shell's resource limits have been changed with ulimit,
+ * commands are forked instead, since the server still has the old ones.
+ *
+ * On Linux the command is started with CLONE_PARENT, which makes it a
+ * child of the shell rather than of the server, so the shell waits for it
+ * as for any other command. Elsewhere the fork server is not available.
+ */
+
+#ifndef FORK_SERVER_H
+#define FORK_SERVER_H
+
+#include <unistd.h>
+
+
+/*
+ * Starts the fork server. Must be called early, before the shell allocates
+ * much memory. Returns 0 on success, or -1 if it could not be started.
+ */
+int start_fork_server();
+
+/*
+ * Returns true if commands can be started by the fork server. Always false
+ * in a child of the shell (such as a process substitution), which must
+ * not share the shell's connection to the server.
+ */
+bool fork_server_available();
+
+/*
+ * Starts a command with the fork server. The command inherits the shell's
+ * descriptors 0 to 9 that are not close-on-exec, its working directory,
+ * its umask, and its environment. Returns the pid of the command, which is a child of
+ * the shell, or -1 if the server could not start it (in which case the
+ * caller should fork instead).
+ */
+pid_t spawn_with_fork_server(char **args);
+
+
+#endif
@@ -28,12 +28,14 @@ public:
     // data access
     T2 get(T1 key);
     T2 operator[](T1 key);
+    T2& getReference(T1 key);
     bool contains(T1 key);
 
     // modifiers
     void insert(T1 key, T2 value);
     void remove(T1 key);
     T2 extract(T1 key);
+    void clear();
 };
 
 
@@ -83,6 +85,15 @@ T2 Table<T1, T2>::operator[](T1 key)
 }
 
 
+// returns the stored value itself, so that it can be modified in place
+
+template<typename T1, typename T2>
+T2& Table<T1, T2>::getReference(T1 key)
+{
+    return _table[key];
+}
+
+
 template<typename T1, typename T2>
 bool Table<T1,T2>::contains(T1 key)
 {
@@ -115,4 +126,11 @@ T2 Table<T1, T2>::extract(T1 key)
 }
 
 
+template<typename T1, typename T2>
+void Table<T1, T2>::clear()
+{
+    _table.clear();
+}
+
+
 #endif
\ No newline at end of file
@@ -0,0 +1,54 @@
+/* File: history.h
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * This header defines the command history. History is kept in an
+ * append-only file with one command per line. Every session appends
+ * each command with a single O_APPEND write, so several shells can share
+ * the file safely, and nothing is ever rewritten. The file is only read
+ * (by mapping it into memory) the first time history is actually used.
+ */
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <string>
+
+
+// name of the history file in the home directory if HISTFILE is not set
+#define HISTORY_FILE_NAME ".josh_history"
+
+// substring searches use an index of every 3-byte sequence in the history
+#define HISTORY_NGRAM_LENGTH 3
+
+
+/*
+ * Appends a command to the history file. Does not load the history.
+ */
+void add_history(const std::string& line);
+
+/*
+ * Returns the number of entries in the history, including any appended
+ * to the file by other sessions since it was last checked.
+ */
+int history_length();
+
+/*
+ * Returns the entry with the given index, where 0 is the oldest.
+ */
+std::string history_entry(int index);
+
+/*
+ * Returns the index of the most recent entry before the given index that
+ * contains query, or -1 if there is none.
+ */
+int search_history(const std::string& query, int before);
+
+/*
+ * Expands a line starting with '!': '!!' is the previous command and
+ * '!prefix' is the most recent command starting with prefix. Returns
+ * false if there is no such command. Other lines are left alone.
+ */
+bool expand_history(std::string& line);
+
+
+#endif
@@ -15,6 +15,8 @@
 #include <vector>
 #include <string>
 
+#include <sys/types.h>
+
 
 
 /* 
@@ -28,6 +30,31 @@
 
 
 
+/*
+ * A redirection of a numbered file descriptor: 'N>file', 'N>>file',
+ * 'N<file', 'N>&M' (duplicate M as N), or 'N>&-' (close N). These are
+ * applied after the standard input, output, and error files, in the
+ * order they were written.
+ */
+typedef enum
+{
+    FD_OPEN_WRITE,
+    FD_OPEN_APPEND,
+    FD_OPEN_READ,
+    FD_DUPLICATE,
+    FD_CLOSE
+} fd_action_t;
+
+typedef struct
+{
+    int fd;
+    fd_action_t action;
+    std::string path;
+    int source_fd;
+} fd_redirection_t;
+
+
+
 /*
  * Command class represents a single command in a given pipeline. It consists
  * of an array of strings that represent the command name, arguments, and flags.
@@ -51,6 +78,9 @@ private:
     bool _redirectError;
     std::vector<std::string> _errorFiles;
 
+    // used for numbered file descriptors (i.e. exec 3> log.txt, ls 2>&1)
+    std::vector<fd_redirection_t> _fdRedirections;
+
     // token array stores the command entered (without the redirection)
     int _numTokens;
     std::vector<std::string> _tokenArray;
@@ -107,6 +137,9 @@ public:
     std::vector<std::string>& getErrorFiles();
     void addErrorFile(std::string errorFile);
 
+    std::vector<fd_redirection_t>& getFdRedirections();
+    void addFdRedirection(const fd_redirection_t& redirection);
+
     // numTokens has no setter. set when token array is set
     int getNumTokens();
     std::vector<std::string>& getTokenArray();
@@ -115,6 +148,46 @@ public:
 
 void operator<<(std::ostream& cout, Command& command);
 
+/*
+ * Fills args with the command's tokens followed by NULL, in the form that
+ * execvp takes. args must have room for num_args+1 pointers. The pointers
+ * are into the command's own strings, so they are valid as long as the
+ * command is and nothing is copied or allocated.
+ */
+void make_args(Command& command, char **args, int num_args);
+
+/*
+ * The exit status of a command whose execvp failed with the given errno,
+ * as in other shells: 127 if it was not found, and 126 if it was found
+ * but could not be run (e.g. it is not executable).
+ */
+int exec_failure_status(int error);
+
+
+
+/*
+ * A running process substitution ('<(cmd)' or '>(cmd)') of one of the
+ * commands in a job: the process running cmd, and the shell's end of the
+ * pipe to it, which the command gets as /dev/fd/N.
+ */
+typedef struct
+{
+    int command;
+    pid_t pid;
+    int fd;
+} process_substitution_t;
+
+
+/*
+ * A descriptor the shell writes to a coprocess on, and the pipe it was
+ * opened on, so that it is only closed if the script has not reused it.
+ */
+typedef struct
+{
+    int fd;
+    ino_t pipe;
+} coprocess_fd_t;
+
 
 
 /*
@@ -133,6 +206,9 @@ private:
     bool _background;
     int _numCommands;
     std::vector<Command> _commands;
+    std::vector<process_substitution_t> _processSubstitutions;
+    std::vector<pid_t> _pids;
+    std::vector<coprocess_fd_t> _coprocessFds;
     
 
 public:
@@ -145,6 +221,53 @@ public:
     std::vector<Command>& getCommands();
     void setBackground(bool isBackground);
     void addCommand(const Command& command);
+
+    std::vector<process_substitution_t>& getProcessSubstitutions();
+    void addProcessSubstitution(const process_substitution_t& substitution);
+
+    // the processes started for the job, removed as they are reaped
+    std::vector<pid_t>& getPids();
+    void addPid(pid_t pid);
+
+    // the descriptors the shell writes to a coprocess on, closed when it is reaped
+    std::vector<coprocess_fd_t>& getCoprocessFds();
+    void addCoprocessFd(const coprocess_fd_t& coprocessFd);
+};
+
+
+
+/*
+ * When a job of a command list runs, depending on the exit status of the
+ * job before it: always after ';' (or '&'), only if it succeeded after
+ * '&&', and only if it failed after '||'.
+ */
+typedef enum
+{
+    RUN_ALWAYS,
+    RUN_IF_SUCCEEDED,
+    RUN_IF_FAILED
+} run_condition_t;
+
+
+/*
+ * The class JobList stores a command line once it is parsed: a list of
+ * jobs separated by ';', '&', '&&', and '||', each with the condition it
+ * runs on. A line without any of these is a list of one job.
+ */
+class JobList
+{
+private:
+    std::vector<Job> _jobs;
+    std::vector<run_condition_t> _conditions;
+
+public:
+    JobList();
+    ~JobList();
+
+    int getNumJobs();
+    std::vector<Job>& getJobs();
+    std::vector<run_condition_t>& getConditions();
+    void addJob(const Job& job, run_condition_t condition);
 };
 
 
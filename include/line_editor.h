@@ -0,0 +1,76 @@
+/* File: line_editor.h
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * This header defines the line editor used to read commands from the
+ * terminal. When standard input is a terminal it is put into raw mode
+ * while a line is being edited, and only the part of the line that
+ * changed is redrawn. Otherwise lines are read from a plain buffer.
+ */
+
+#ifndef LINE_EDITOR_H
+#define LINE_EDITOR_H
+
+#include <string>
+#include <vector>
+
+
+/*
+ * Size of the buffer that input is read into. A paste larger than this
+ * is simply processed in several chunks.
+ */
+#define LINE_EDITOR_BUFFER_SIZE 4096
+
+/*
+ * Size of the buffer that batch mode reads commands into, so a generated
+ * stream of commands costs one read for many lines.
+ */
+#define BATCH_BUFFER_SIZE (1024*1024)
+
+/*
+ * Maximum number of completions listed without asking the user first.
+ */
+#define LINE_EDITOR_QUERY_ITEMS 100
+
+
+/*
+ * Function called when Tab is pressed. It returns the possible completions
+ * of the word ending at the cursor and sets word_start to the offset in
+ * line where that word begins.
+ */
+typedef std::vector<std::string> (*completion_function_t)(const std::string& line, size_t cursor, size_t& word_start);
+
+
+/*
+ * Sets the function used for tab completion. Tab does nothing until one
+ * has been set.
+ */
+void set_completion_function(completion_function_t function);
+
+/*
+ * Prints the prompt and reads a single line from standard input into line,
+ * without the trailing newline. Supports the usual emacs-style editing keys
+ * (Ctrl-A, Ctrl-E, Ctrl-K, Ctrl-U, Ctrl-W, arrows, Home, End, Delete).
+ * Returns false on end of file.
+ */
+bool read_line(const std::string& prompt, std::string& line);
+
+/*
+ * Reads a single line for batch mode, without a prompt or any editing.
+ * Returns false on end of file.
+ */
+bool read_batch_line(std::string& line);
+
+/*
+ * Like read_batch_line, but only returns a line that has already been read
+ * into the buffer, so it never blocks. Returns false if there is none.
+ */
+bool read_buffered_batch_line(std::string& line);
+
+/*
+ * Restores the terminal settings saved when raw mode was first entered.
+ * Safe to call even if raw mode was never entered.
+ */
+void restore_terminal();
+
+
+#endif
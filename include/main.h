@@ -2,6 +2,7 @@
 #define MAIN_H
 
 #include <string>
+#include <vector>
 #include <hashtable.h>
 #include <job.h>
 #include <builtin.h>
@@ -17,4 +18,12 @@ void initialize_job_table();
 void initialize_alias_table();
 void initialize_sighandler_table();
 
+bool parse_tokens(const std::vector<std::string>& tokens, JobList& list);
+void execute_job(Job& job);
+void execute_list(JobList& list);
+void reap_background_jobs();
+void wait_for_background_jobs();
+int foreground_job(int job_number);
+void shell_exit(int status);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,55 @@
+/* File: output.h
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * This header defines the buffered output used by the builtins and the
+ * shell's own messages. Output for a file descriptor is collected in a
+ * buffer and written with a single writev when the buffer fills, when
+ * output switches to another file descriptor, or when the shell finishes
+ * a command, instead of one write per line. Normal output goes to
+ * standard output and diagnostics to standard error.
+ */
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <string>
+#include <stddef.h>
+
+
+// size of the output buffer
+#define OUTPUT_BUFFER_SIZE 65536
+
+
+/*
+ * Adds data to the buffer for a file descriptor. If it does not fit, the
+ * buffer and the data are written together with writev, so large writes
+ * are never copied. If another file descriptor has output waiting, that
+ * is written first, so standard output and standard error going to the
+ * same terminal stay in order.
+ */
+void write_output(int fd, const char *data, size_t length);
+void write_output(int fd, const std::string& text);
+
+/*
+ * Writes a line to standard output.
+ */
+void print_output(const std::string& line);
+
+/*
+ * Writes a line to standard error.
+ */
+void print_error(const std::string& line);
+
+/*
+ * Writes anything buffered for the file descriptor.
+ */
+void flush_output(int fd);
+
+/*
+ * Writes everything that is buffered. Called when a command finishes,
+ * before the shell forks, and before it exits.
+ */
+void flush_all_output();
+
+
+#endif
@@ -32,11 +32,30 @@ std::vector<std::string> tokenize(char *inputString, char *delimiters);
  */
 Job parse_job(std::vector<std::string> tokens);
 
+/*
+ * Parses the tokens of a whole command line, which may be a list of jobs
+ * separated by ';', '&', '&&', and '||', into a JobList. Calls parse_job
+ * for each job.
+ */
+JobList parse_list(std::vector<std::string> tokens);
+
 /*
  * Function that is called by parse_job to parse an individual command.
  */
 Command parse_command(std::vector<std::string> tokens);
 
+/*
+ * Returns true if a token is a process substitution, '<(cmd)' or '>(cmd)'.
+ * parse_job joins the tokens of each one back together, so it is always a
+ * single token.
+ */
+bool is_process_substitution(const std::string& token);
+
+/*
+ * Returns the command inside a process substitution.
+ */
+std::string get_substituted_command(const std::string& token);
+
 
 /*
  * This function is the wrapper function for the lexical analysis
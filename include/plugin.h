@@ -0,0 +1,85 @@
+/* File: plugin.h
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * This header defines the ABI for loadable builtins. A loadable builtin
+ * lives in a shared object that is loaded with 'enable -f file.so name'
+ * and exports one plugin struct per builtin it provides. Once loaded, the
+ * builtin is inserted into the builtin table alongside the compiled-in
+ * builtins, so looking it up costs exactly the same.
+ */
+
+#ifndef PLUGIN_H
+#define PLUGIN_H
+
+#include <string>
+#include <builtin.h>
+
+
+/*
+ * Version of the plugin ABI. Must be bumped whenever the layout of
+ * builtin_plugin_t or the builtin_t signature changes so that plugins
+ * compiled against an older header are rejected instead of crashing.
+ */
+#define BUILTIN_PLUGIN_ABI_VERSION 1
+
+
+/*
+ * Suffix appended to the builtin name to get the name of the symbol
+ * that the shared object must export. For example, the builtin 'hello'
+ * is found by looking up the symbol 'hello_plugin'.
+ */
+#define BUILTIN_PLUGIN_SYMBOL_SUFFIX "_plugin"
+
+
+/*
+ * Struct exported by the shared object for each builtin. The abi_version
+ * and struct_size fields are checked before anything else is touched.
+ */
+typedef struct
+{
+    int abi_version;
+    unsigned int struct_size;
+    const char *name;
+    builtin_t function;
+    const char *usage;
+} builtin_plugin_t;
+
+
+/*
+ * Convenience macro for plugin authors. Defines and exports the plugin
+ * struct for a builtin with the given name and function. Must be used
+ * at file scope in the plugin source.
+ */
+#define DEFINE_BUILTIN_PLUGIN(name, function, usage) \
+    extern "C" builtin_plugin_t name##_plugin; \
+    builtin_plugin_t name##_plugin = \
+        { BUILTIN_PLUGIN_ABI_VERSION, sizeof(builtin_plugin_t), #name, function, usage }
+
+
+/*
+ * Loads the builtin with the given name from the shared object at path
+ * and registers it in the builtin table. Returns 0 on success and -1 on
+ * failure, in which case an error message is printed.
+ */
+int load_builtin_plugin(std::string path, std::string name);
+
+/*
+ * Removes a builtin that was previously loaded with load_builtin_plugin.
+ * If it shadowed a compiled-in builtin, that builtin is restored. The
+ * shared object is closed once none of its builtins are still loaded.
+ */
+int unload_builtin_plugin(std::string name);
+
+/*
+ * Returns true if the named builtin was loaded from a shared object.
+ */
+bool is_plugin_builtin(std::string name);
+
+/*
+ * Prints every builtin currently in the builtin table, marking the ones
+ * that were loaded from a shared object.
+ */
+void print_builtins();
+
+
+#endif
@@ -0,0 +1,83 @@
+/* File: priority.h
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * This header defines the priority policy for background jobs. So that a
+ * long build started with '&' does not slow down the commands typed after
+ * it, every process of a background job is made nicer than the shell and
+ * given a lower I/O priority before it execs, which everything it starts
+ * inherits. fg puts a job back to the shell's own priority when it is
+ * brought to the foreground.
+ *
+ * The policy is set with the bgpriority builtin:
+ *
+ *     bgpriority -n 10 -c best-effort -l 7    the default
+ *     bgpriority -c idle                      I/O only when the disk is idle
+ *     bgpriority -o                           run background jobs as normal
+ *
+ * The I/O priority is only set on Linux.
+ */
+
+#ifndef PRIORITY_H
+#define PRIORITY_H
+
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+
+typedef enum
+{
+    IO_CLASS_NONE,
+    IO_CLASS_BEST_EFFORT,
+    IO_CLASS_IDLE
+} io_class_t;
+
+typedef struct
+{
+    bool enabled;
+
+    // added to the shell's niceness
+    int nice;
+
+    io_class_t io_class;
+
+    // 0 (highest) to 7 (lowest), for the best-effort class
+    int io_level;
+} background_policy_t;
+
+
+/*
+ * The policy applied to background jobs.
+ */
+background_policy_t& background_policy();
+
+/*
+ * Parses bgpriority's arguments into policy. Returns -1 (having printed
+ * why) if they are not valid.
+ */
+int parse_background_policy(const std::vector<std::string>& args, background_policy_t& policy);
+
+/*
+ * Prints a policy as the bgpriority command that sets it.
+ */
+void print_background_policy(const background_policy_t& policy);
+
+/*
+ * Lowers the priority of the current process, a process of a background
+ * job between fork and exec, according to the policy, so that everything
+ * it starts has the lower priority too. Failing to change the priority is
+ * not an error: the job runs as it would have.
+ */
+void apply_background_policy();
+
+/*
+ * Gives a process of a job brought to the foreground the shell's own CPU
+ * and I/O priority back, as far as it can: lowering niceness needs
+ * privileges (or a RLIMIT_NICE) that most users do not have. Returns -1,
+ * having printed why if report is set, if either could not be restored.
+ */
+int restore_priority(pid_t pid, bool report);
+
+
+#endif
@@ -0,0 +1,53 @@
+/* File: prompt.h
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * This header defines the functions for rendering the prompt. The prompt
+ * is described by a PS1-style template that is compiled into a list of
+ * segments once, and the values it uses (user, host, working directory)
+ * are cached, so rendering a prompt is just joining strings. The version
+ * control segment is computed on a worker thread and never waited for.
+ */
+
+#ifndef PROMPT_H
+#define PROMPT_H
+
+#include <string>
+
+
+// template used when PS1 is not set: user@host dir %
+#define DEFAULT_PROMPT_TEMPLATE "\\u@\\h \\W % "
+
+// how long the version control status may take before it is abandoned
+#define PROMPT_VCS_DEADLINE_MS 500
+
+
+/*
+ * Looks up the user name, host name, and working directory used by the
+ * prompt. Returns -1 if the host name could not be found.
+ */
+int initialize_prompt();
+
+/*
+ * Updates the cached working directory. Must be called whenever the
+ * working directory of the shell changes (i.e. by cd). Does nothing if
+ * the prompt was never initialized.
+ */
+void update_prompt_directory();
+
+/*
+ * Returns the cached working directory of the shell.
+ */
+const std::string& get_prompt_directory();
+
+/*
+ * Renders the prompt from the PS1 template. The template is only compiled
+ * again when PS1 changes. Supports \u (user), \h (host up to the first
+ * '.'), \H (host), \w (working directory, with ~ for the home directory),
+ * \W (last part of the working directory), \$ ('#' for root, otherwise
+ * '$'), \n (newline), \\ (backslash), and \g (version control branch and
+ * status, computed in the background).
+ */
+std::string make_prompt();
+
+
+#endif
@@ -0,0 +1,87 @@
+/* File: redirect.h
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * This header defines the redirection of a command's standard input,
+ * output, and error, and of the numbered file descriptors 0 to 9. A
+ * command can name several files for the same stream, like zsh's MULTIOS
+ * option: 'cmd > a > b' writes the output to both files, and 'cmd < a < b'
+ * reads a and then b. Several output files are fed by a relay process that
+ * copies the command's output with tee and splice, so the data is never
+ * copied through user space.
+ */
+
+#ifndef REDIRECT_H
+#define REDIRECT_H
+
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include <job.h>
+
+
+// size requested for the pipes used by the relay, so each tee moves more data
+#define RELAY_PIPE_SIZE (1024*1024)
+
+// permissions for files created by output redirection, before the umask
+#define REDIRECT_FILE_MODE 0666
+
+
+/*
+ * A helper process started for a stream with several files, and the
+ * descriptor that was pointed at its pipe.
+ */
+typedef struct
+{
+    int fd;
+    pid_t pid;
+} relay_helper_t;
+
+/*
+ * What redirect_shell changed: each descriptor with the copy it was saved
+ * to (-1 if it was closed), and the helper processes it started.
+ */
+typedef struct
+{
+    std::vector<std::pair<int, int>> saved_fds;
+    std::vector<relay_helper_t> helpers;
+} shell_redirection_t;
+
+
+/*
+ * Sets up the redirections of a command. Must be called in the forked
+ * child, after it has been connected to the rest of the pipeline. If any
+ * stream has more than one file, this forks again: the command continues
+ * in the new process, and the calling process waits for it and for the
+ * relays and then exits with the command's status. has_deadline is true
+ * if the shell enforces a timeout on the job, so that the watchdog has to
+ * be able to kill the relays as well. Exits if a file cannot be opened.
+ */
+void do_redirection(Job& job, Command& current_command, int command_number, bool has_deadline);
+
+/*
+ * Applies the redirections of a builtin to the shell itself. If saved is
+ * not NULL, every descriptor that is changed is saved there first, to be
+ * put back by restore_shell_redirection. Otherwise the change is permanent,
+ * as done by exec, and the shell keeps the helpers it started until the
+ * descriptor is redirected again or the shell exits. Prints an error and
+ * returns -1 if a redirection fails, after putting back what it had
+ * changed.
+ */
+int redirect_shell(Command& command, shell_redirection_t *saved);
+
+/*
+ * Puts back the descriptors saved by redirect_shell and waits for the
+ * helpers it started.
+ */
+void restore_shell_redirection(shell_redirection_t& saved);
+
+/*
+ * Closes the descriptors that exec pointed at helpers and waits for the
+ * helpers to finish writing the files. Called when the shell exits.
+ */
+void finish_shell_redirections();
+
+
+#endif
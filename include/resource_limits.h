@@ -0,0 +1,79 @@
+/* File: resource_limits.h
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * This header defines the parsing and setting of resource limits, used by
+ * the ulimit builtin to change the shell's own limits (which every command
+ * inherits) and by the 'limit' command prefix to change them only in the
+ * process of one command, e.g. 'limit -v 1048576 -t 60 make | tee log'.
+ *
+ * Both take the options of ulimit: -S and -H to set only the soft or hard
+ * limit (both are set by default), and a letter for each limit followed
+ * by its value or 'unlimited'. Sizes are in KiB and CPU time in seconds.
+ */
+
+#ifndef RESOURCE_LIMITS_H
+#define RESOURCE_LIMITS_H
+
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+
+typedef struct
+{
+    char option;
+    int resource;
+
+    // bytes (or seconds, or 1 for counts) per unit of the value given
+    rlim_t unit;
+
+    const char *description;
+} limit_type_t;
+
+typedef struct
+{
+    const limit_type_t *type;
+    bool has_value;
+    rlim_t value;
+} limit_request_t;
+
+typedef struct
+{
+    bool soft;
+    bool hard;
+    bool all;
+    std::vector<limit_request_t> requests;
+} limit_arguments_t;
+
+
+/*
+ * Parses limit options starting at tokens[first]. With values_required,
+ * as for the prefix, every limit needs a value. Otherwise a limit with no
+ * value is printed. Returns the index of the first token after the
+ * options, or -1 (having printed why) if they are not valid.
+ */
+int parse_limit_arguments(const std::vector<std::string>& tokens, size_t first, bool values_required, \
+    limit_arguments_t& arguments);
+
+/*
+ * Sets the limits that were given a value on the current process. Returns
+ * -1 (having printed why) if one of them cannot be set.
+ */
+int set_limits(limit_arguments_t& arguments);
+
+/*
+ * Returns true once set_limits has changed a limit of this process. The
+ * fork server was started with the limits the shell had then, so from
+ * that point on its commands would not get the shell's.
+ */
+bool limits_changed();
+
+/*
+ * Prints the limits that were not given a value, every limit with -a, or
+ * the file size limit if no limit was named, like ulimit.
+ */
+void print_limits(limit_arguments_t& arguments);
+
+
+#endif
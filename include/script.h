@@ -0,0 +1,59 @@
+/* File: script.h
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * This header defines the functions for running shell scripts inside the
+ * current shell process, as done by the source and . builtins. Parsed
+ * scripts are cached so that sourcing an unchanged file again only costs
+ * a stat call.
+ */
+
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include <job.h>
+
+
+/*
+ * A non-empty, non-comment line of a script, split into tokens, and the
+ * commands parsed from it. An alias the script defines changes how the
+ * lines after it parse, so a line is parsed again when it runs if the
+ * aliases have changed since it was last parsed.
+ */
+typedef struct
+{
+    int line_number;
+    std::vector<std::string> tokens;
+
+    // whether the line has been parsed, under which alias generation, and
+    // whether it was valid syntax
+    bool parsed;
+    unsigned long alias_generation;
+    bool valid;
+    JobList list;
+} script_line_t;
+
+
+/*
+ * Returns the lines of the script at path. The result is cached by the
+ * device, inode, modification time, and size of the file, so it is only
+ * read again when the file changes.
+ *
+ * WARNING: Throws an exception if the file cannot be read.
+ */
+std::shared_ptr<std::vector<script_line_t>> get_script(std::string path);
+
+/*
+ * Reads (or fetches from the cache) the script at path and executes each
+ * of its lines in turn in the current shell process. A line that is not
+ * valid syntax is reported and skipped, as it would be on the command
+ * line. Returns 0 on success and -1 if the script could not be read or a
+ * line of it could not be parsed.
+ */
+int source_script(std::string path);
+
+
+#endif
@@ -0,0 +1,78 @@
+/* File: stats.h
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * This header defines the shell's statistics: counters of the things that
+ * cost it time (forks, execs, parse errors, etc.) and histograms of how
+ * long parsing, starting commands, and foreground jobs take. They are
+ * always collected, and the stats builtin prints them.
+ *
+ * The counters live in shared memory, so that children (including those
+ * of the fork server) can count their own execs and exec failures. The
+ * histograms are only recorded by the shell itself. Like an HDR histogram,
+ * each power of two is split into STATS_SUB_BUCKETS buckets, so a value is
+ * recorded with one increment and reported within about 6 percent.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+
+// buckets per power of two in the histograms
+#define STATS_SUB_BUCKET_BITS 4
+#define STATS_SUB_BUCKETS (1 << STATS_SUB_BUCKET_BITS)
+
+
+typedef enum
+{
+    STAT_FORKS,
+    STAT_EXECS,
+    STAT_EXEC_FAILURES,
+    STAT_SCRIPT_CACHE_HITS,
+    STAT_SCRIPT_CACHE_MISSES,
+    STAT_PARSE_ERRORS,
+    STAT_BUILTIN_CALLS,
+    NUM_STAT_COUNTERS
+} stat_counter_t;
+
+
+typedef enum
+{
+    STAT_PARSE_TIME,
+    STAT_SPAWN_LATENCY,
+    STAT_FOREGROUND_JOB_TIME,
+    NUM_STAT_HISTOGRAMS
+} stat_histogram_t;
+
+
+/*
+ * Maps the shared counters. Must be called before the shell forks
+ * anything (including the fork server) for the children's counts to be
+ * seen. Until then, and if the mapping fails, counts are kept privately.
+ */
+void start_stats();
+
+/*
+ * Adds one to a counter.
+ */
+void count_stat(stat_counter_t counter);
+
+/*
+ * Returns the current time for the histograms, in nanoseconds.
+ */
+uint64_t stats_clock();
+
+/*
+ * Records the time from start until now in a histogram.
+ */
+void record_stat(stat_histogram_t histogram, uint64_t start);
+
+/*
+ * Prints every counter and a summary of every histogram, as a table or
+ * as JSON.
+ */
+void print_stats(bool json);
+
+
+#endif
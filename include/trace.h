@@ -0,0 +1,105 @@
+/* File: trace.h
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * This header defines the tracing of the command lifecycle, turned on by
+ * setting JOSH_TRACE to the path of a file. Spans are recorded for each
+ * phase of the main loop (reading, parsing, executing) and for each
+ * child: from fork to exec in the child itself, and from exec until the
+ * shell reaps it. When the shell exits they are written to the file in
+ * the Chrome trace event format, which chrome://tracing and Perfetto open.
+ *
+ * Events go into a ring in shared memory, so forked children record
+ * into the same ring as the shell. A writer claims a slot with a single
+ * atomic increment and never waits. When the ring is full the oldest
+ * events are overwritten. With tracing off, every trace call is an
+ * inline check of trace_enabled.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#include <unistd.h>
+
+
+// number of events the ring holds before it overwrites the oldest
+#define TRACE_RING_EVENTS (64*1024)
+
+// bytes of detail (e.g. the command name) kept with an event
+#define TRACE_DETAIL_LENGTH 40
+
+
+extern bool trace_enabled;
+
+
+/*
+ * Starts tracing if JOSH_TRACE is set. It is removed from the environment
+ * so that commands (including other shells) do not trace into the file.
+ */
+void start_tracing();
+
+/*
+ * Writes the recorded events to the trace file. Only does anything in the
+ * process that started tracing.
+ */
+void finish_tracing();
+
+/*
+ * Returns the current time for the trace, in nanoseconds.
+ */
+uint64_t trace_clock();
+
+/*
+ * Records an event. phase is a Chrome trace phase: 'X' for a span from
+ * start to end, 'B' or 'E' for the start or end of a span (at start), and
+ * 'M' to name the process pid with detail. detail may be NULL.
+ */
+void trace_record(const char *name, char phase, pid_t pid, uint64_t start, uint64_t end, const char *detail);
+
+
+/*
+ * Returns the start time of a span, or 0 if tracing is off.
+ */
+inline uint64_t trace_start()
+{
+    return trace_enabled ? trace_clock() : 0;
+}
+
+/*
+ * Records a span of the current process from start until now.
+ */
+inline void trace_span(const char *name, uint64_t start, const char *detail = NULL)
+{
+    if(trace_enabled)
+        trace_record(name, 'X', getpid(), start, trace_clock(), detail);
+}
+
+
+/*
+ * Called in a child just before it execs the command: records the time
+ * from fork (child_start) to exec, names the child's track after the
+ * command, and starts the span that trace_exit ends.
+ */
+inline void trace_exec(uint64_t child_start, const char *command)
+{
+    if(!trace_enabled)
+        return;
+
+    pid_t pid = getpid();
+    trace_record("fork to exec", 'X', pid, child_start, trace_clock(), command);
+    trace_record("process_name", 'M', pid, 0, 0, command);
+    trace_record("exec", 'B', pid, trace_clock(), 0, command);
+}
+
+/*
+ * Called by the shell when it has reaped a child, to end its exec span.
+ */
+inline void trace_exit(pid_t pid)
+{
+    if(trace_enabled)
+        trace_record("exec", 'E', pid, trace_clock(), 0, NULL);
+}
+
+
+#endif
@@ -0,0 +1,54 @@
+/* File: trie.h
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * This header defines a prefix tree of strings used for completion. Each
+ * string is reference counted, so the same name can be inserted from
+ * several sources (e.g. two PATH directories) and only disappears once
+ * every source has removed it.
+ */
+
+#ifndef TRIE_H
+#define TRIE_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+class Trie
+{
+private:
+
+    struct Node
+    {
+        int count;
+        std::map<char, std::unique_ptr<Node>> children;
+
+        Node() : count(0) {}
+    };
+
+    Node _root;
+    int _size;
+
+    void collect(const Node *node, std::string& prefix, std::vector<std::string>& results) const;
+
+public:
+
+    Trie();
+    ~Trie();
+
+    // number of distinct strings in the trie
+    int size() const;
+
+    // modifiers. insert and remove adjust the reference count of the string
+    void insert(const std::string& key);
+    void remove(const std::string& key);
+
+    // data access
+    bool contains(const std::string& key) const;
+    std::vector<std::string> withPrefix(const std::string& prefix) const;
+};
+
+
+#endif
@@ -0,0 +1,76 @@
+/* File: watchdog.h
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * This header defines the deadlines of foreground jobs. A job can be given
+ * one with the timeout prefix, written before the command (or any stage of
+ * a pipeline):
+ *
+ *     timeout 30 make               give make 30 seconds
+ *     timeout -k 5 1m cat x | sort  SIGKILL 5 seconds after the SIGTERM
+ *
+ * and every foreground job gets one if JOSH_TIMEOUT is set to a duration.
+ * (bash's TMOUT logs an idle shell out, which is not what this does.)
+ * Durations are in seconds, or with an s, m, h, or d suffix, and may have
+ * a fraction. The shortest deadline written in a job is the job's.
+ *
+ * When the deadline passes, every stage still running is sent SIGTERM, and
+ * SIGKILL if it is still running after the grace period. A stage with
+ * several files for one stream passes SIGTERM on to its command, and its
+ * command and relays are killed with it. The shell waits
+ * on a pidfd for each stage with a single poll, so there is no helper
+ * process and nothing is polled in a loop.
+ *
+ * A background job keeps its timeout, which then runs the timeout program,
+ * since the shell is not waiting for it. Deadlines are only enforced on
+ * Linux; elsewhere the shell waits for the job as if it had none.
+ */
+
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+
+// the grace period between SIGTERM and SIGKILL when -k is not given
+#define DEFAULT_KILL_AFTER_MS 2000
+
+
+typedef struct
+{
+    // 0 for no deadline
+    long duration_ms;
+    long kill_after_ms;
+} job_timeout_t;
+
+
+/*
+ * Parses a duration like '30', '1.5m', or '2h' into milliseconds. Returns
+ * false if it is not one.
+ */
+bool parse_duration(const std::string& text, long& milliseconds);
+
+/*
+ * Parses the options and duration of a timeout prefix starting at
+ * tokens[first], just after 'timeout'. Returns the index of the first
+ * token after them, or -1 if they are not a valid timeout prefix.
+ */
+int parse_timeout_arguments(const std::vector<std::string>& tokens, size_t first, job_timeout_t& timeout);
+
+/*
+ * The deadline that JOSH_TIMEOUT gives every foreground job, if it is set.
+ */
+job_timeout_t default_timeout();
+
+/*
+ * Waits for every one of the processes of a foreground job, enforcing the
+ * timeout, and fills statuses with their wait statuses, in the same order.
+ * name is the job's, for the message printed if it timed out.
+ */
+void wait_for_processes(const std::vector<pid_t>& pids, const job_timeout_t& timeout, const std::string& name, \
+    std::vector<int>& statuses);
+
+
+#endif
@@ -0,0 +1,369 @@
+/*
+ * File: affinity.cc
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * This file implements pin's options and applies placements. The node of
+ * each CPU is read from sysfs the first time a pipeline is spread, and
+ * kept for the rest of the session.
+ */
+
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+
+#if defined(__linux__)
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+
+
+#include <affinity.h>
+#include <output.h>
+
+
+// highest CPU and node numbers accepted, plus one
+#define MAX_PLACEMENT_CPUS 1024
+#define MAX_PLACEMENT_NODES 1024
+
+#define NODE_DIRECTORY "/sys/devices/system/node"
+
+
+static placement_t shell_placement = {false, std::vector<int>(), std::vector<int>()};
+
+
+
+/*
+ * Parses a list like '0-3,8,10-11'. Returns false if it is not one, or
+ * names a number from limit up.
+ */
+static bool parse_cpu_list(const std::string& text, int limit, std::vector<int>& numbers)
+{
+    numbers.clear();
+    size_t start = 0;
+
+    while(start <= text.size())
+    {
+        size_t end = text.find(',', start);
+        if(end == std::string::npos)
+            end = text.size();
+
+        std::string range = text.substr(start, end - start);
+        size_t dash = range.find('-');
+
+        std::string low_text = range.substr(0, dash);
+        std::string high_text = (dash == std::string::npos) ? low_text : range.substr(dash + 1);
+
+        if(low_text.empty() || high_text.empty() || low_text.size() > 4 || high_text.size() > 4 || \
+            low_text.find_first_not_of("0123456789") != std::string::npos || \
+            high_text.find_first_not_of("0123456789") != std::string::npos)
+        {
+            return false;
+        }
+
+        int low = std::stoi(low_text);
+        int high = std::stoi(high_text);
+        if(low > high || high >= limit)
+            return false;
+
+        for(int number = low; number <= high; number++)
+            numbers.push_back(number);
+
+        start = end + 1;
+    }
+
+    return !numbers.empty();
+}
+
+
+static std::string format_list(const std::vector<int>& numbers)
+{
+    std::string text;
+
+    for(size_t i = 0; i < numbers.size(); )
+    {
+        size_t last = i;
+        while(last+1 < numbers.size() && numbers[last+1] == numbers[last] + 1)
+            last++;
+
+        if(!text.empty())
+            text += ",";
+
+        text += std::to_string(numbers[i]);
+        if(last > i)
+            text += "-" + std::to_string(numbers[last]);
+
+        i = last + 1;
+    }
+
+    return text;
+}
+
+
+int parse_placement_arguments(const std::vector<std::string>& tokens, size_t first, bool off, placement_t& placement)
+{
+    size_t i = first;
+
+    while(i < tokens.size() && tokens[i].size() == 2 && tokens[i][0] == '-')
+    {
+        char option = tokens[i][1];
+        i++;
+
+        if(option == 's')
+            placement.spread = true;
+
+        else if(option == 'o' && off)
+        {
+            placement.spread = false;
+            placement.cpus.clear();
+            placement.nodes.clear();
+        }
+
+        else if(option == 'c' || option == 'm')
+        {
+            std::vector<int>& numbers = (option == 'c') ? placement.cpus : placement.nodes;
+            int limit = (option == 'c') ? MAX_PLACEMENT_CPUS : MAX_PLACEMENT_NODES;
+
+            if(i == tokens.size() || !parse_cpu_list(tokens[i], limit, numbers))
+            {
+                print_error(std::string("pin: -") + option + ": needs a list like 0-3,8");
+                return -1;
+            }
+
+            i++;
+        }
+
+        else
+        {
+            print_error(std::string("pin: -") + option + ": not an option of pin");
+            return -1;
+        }
+    }
+
+    return i;
+}
+
+
+bool placement_has_command(const std::vector<std::string>& tokens)
+{
+    for(size_t i = 1; i < tokens.size(); i++)
+    {
+        if(tokens[i].compare("-c") == 0 || tokens[i].compare("-m") == 0)
+            i++;
+        else if(tokens[i].size() != 2 || tokens[i][0] != '-')
+            return true;
+    }
+
+    return false;
+}
+
+
+bool placement_is_empty(const placement_t& placement)
+{
+    return !placement.spread && placement.cpus.empty() && placement.nodes.empty();
+}
+
+
+placement_t& default_placement()
+{
+    return shell_placement;
+}
+
+
+void print_placement(const placement_t& placement)
+{
+    if(placement_is_empty(placement))
+    {
+        print_output("pin -o");
+        return;
+    }
+
+    std::string line = "pin";
+
+    if(placement.spread)
+        line += " -s";
+    if(!placement.cpus.empty())
+        line += " -c " + format_list(placement.cpus);
+    if(!placement.nodes.empty())
+        line += " -m " + format_list(placement.nodes);
+
+    print_output(line);
+}
+
+
+
+/*************
+ * Placement *
+ *************/
+
+#if defined(__linux__)
+
+// the node of each CPU, or -1, once sysfs has been read
+static std::vector<int> cpu_nodes;
+static bool cpu_nodes_read = false;
+
+// the CPUs that the stages of the next job are spread over, in order
+static std::vector<int> spread_cpus;
+static int spread_node = -1;
+
+
+static void read_cpu_nodes()
+{
+    cpu_nodes_read = true;
+    cpu_nodes.assign(MAX_PLACEMENT_CPUS, -1);
+
+    DIR *directory = opendir(NODE_DIRECTORY);
+    if(directory == NULL)
+        return;
+
+    struct dirent *entry;
+    while((entry = readdir(directory)) != NULL)
+    {
+        if(strncmp(entry->d_name, "node", 4) != 0 || entry->d_name[4] < '0' || entry->d_name[4] > '9')
+            continue;
+
+        int node = atoi(entry->d_name + 4);
+
+        std::ifstream file(std::string(NODE_DIRECTORY "/") + entry->d_name + "/cpulist");
+        std::string text;
+        std::vector<int> cpus;
+
+        if(!std::getline(file, text) || !parse_cpu_list(text, MAX_PLACEMENT_CPUS, cpus))
+            continue;
+
+        for(int cpu : cpus)
+            cpu_nodes[cpu] = node;
+    }
+
+    closedir(directory);
+}
+
+
+void plan_spread()
+{
+    if(!cpu_nodes_read)
+        read_cpu_nodes();
+
+    spread_cpus.clear();
+
+    cpu_set_t allowed;
+    if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        return;
+
+    int current = sched_getcpu();
+    if(current < 0 || current >= MAX_PLACEMENT_CPUS)
+        current = 0;
+
+    spread_node = cpu_nodes[current];
+
+    /*
+     * the CPUs of the shell's node that it may run on, starting from the
+     * one it is on and wrapping around, so consecutive stages are adjacent
+     */
+    std::vector<int> node_cpus;
+    for(int cpu = 0; cpu < MAX_PLACEMENT_CPUS && cpu < CPU_SETSIZE; cpu++)
+    {
+        if(CPU_ISSET(cpu, &allowed) && cpu_nodes[cpu] == spread_node)
+            node_cpus.push_back(cpu);
+    }
+
+    size_t start = 0;
+    while(start < node_cpus.size() && node_cpus[start] < current)
+        start++;
+
+    for(size_t i = 0; i < node_cpus.size(); i++)
+        spread_cpus.push_back(node_cpus[(start + i) % node_cpus.size()]);
+}
+
+
+static int set_memory_policy(int mode, const std::vector<int>& nodes)
+{
+    unsigned long mask[MAX_PLACEMENT_NODES / (8 * sizeof(unsigned long))] = {0};
+
+    for(int node : nodes)
+        mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+
+    // the kernel reads one bit less than it is told
+    return syscall(SYS_set_mempolicy, mode, mask, MAX_PLACEMENT_NODES + 1);
+}
+
+
+int apply_placement(const placement_t& placement, int stage)
+{
+    if(placement_is_empty(placement))
+        return 0;
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    bool set_cpus = true;
+
+    if(placement.spread && !placement.cpus.empty())
+        CPU_SET(placement.cpus[stage % placement.cpus.size()], &cpus);
+
+    else if(placement.spread)
+    {
+        if(spread_cpus.empty())
+            plan_spread();
+
+        if(spread_cpus.empty())
+            set_cpus = false;
+        else
+            CPU_SET(spread_cpus[stage % spread_cpus.size()], &cpus);
+    }
+
+    else if(!placement.cpus.empty())
+    {
+        for(int cpu : placement.cpus)
+            CPU_SET(cpu, &cpus);
+    }
+
+    else
+        set_cpus = false;
+
+    if(set_cpus && sched_setaffinity(0, sizeof(cpus), &cpus) != 0)
+    {
+        print_error(std::string("pin: ") + strerror(errno));
+        return -1;
+    }
+
+    int result = 0;
+    if(!placement.nodes.empty())
+        result = set_memory_policy(MPOL_BIND, placement.nodes);
+
+    // a spread pipeline keeps its memory near the CPUs it runs on
+    else if(placement.spread && placement.cpus.empty() && spread_node >= 0)
+        result = set_memory_policy(MPOL_PREFERRED, std::vector<int>(1, spread_node));
+
+    if(result != 0)
+    {
+        print_error(std::string("pin: ") + strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+#else
+
+void plan_spread()
+{
+}
+
+
+int apply_placement(const placement_t& placement, int stage)
+{
+    if(placement_is_empty(placement))
+        return 0;
+
+    print_error("pin is only available on Linux");
+    return -1;
+}
+
+#endif
@@ -0,0 +1,205 @@
+/*
+ * File: alias.cc
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * This file implements alias expansion. Expansion works on the token
+ * stream produced by tokenize, before parse_job turns it into a Job, so
+ * an alias may expand into pipes and redirections as well as words.
+ */
+
+
+#include <string>
+#include <vector>
+#include <set>
+
+
+#include <alias.h>
+#include <hashtable.h>
+#include <main.h>
+#include <parse.h>
+
+
+/*
+ * Memoized expansion of a single alias. The tokens are fully expanded,
+ * and chain is set if the word following the alias must also be checked
+ * for an alias (i.e. the value ends with a blank).
+ */
+typedef struct
+{
+    std::vector<std::string> tokens;
+    bool chain;
+} alias_expansion_t;
+
+
+static Table<std::string, alias_expansion_t> expansion_cache;
+
+// bumped whenever an alias changes, so anything parsed earlier can tell
+static unsigned long alias_generation = 0;
+
+
+static alias_expansion_t get_expansion(const std::string& name, std::set<std::string>& active, \
+    std::set<std::string>& suppressed);
+
+
+
+/*
+ * Returns true if the token ends a command, so that the next word is the
+ * first word of a new command and is subject to alias expansion.
+ */
+static bool is_command_separator(const std::string& token)
+{
+    return token.compare("|") == 0 || token.compare(";") == 0 || token.compare("&") == 0 || \
+        token.compare("&&") == 0 || token.compare("||") == 0;
+}
+
+
+/*
+ * Splits an alias value into words, dropping the empty tokens that
+ * tokenize produces for runs of blanks.
+ */
+static std::vector<std::string> split_words(const std::string& value)
+{
+    std::vector<std::string> words;
+
+    for(std::string token : tokenize(value, " \t"))
+    {
+        size_t stop = token.find_last_not_of(" \t");
+        if(stop != std::string::npos)
+            words.push_back(token.substr(0, stop+1));
+    }
+
+    return words;
+}
+
+
+/*
+ * Expands the command words of a token sequence. Aliases in the active set
+ * are currently being expanded and are left alone; their names are added
+ * to suppressed so the caller knows the result depends on the active set.
+ * Returns true if the last word was an alias whose expansion chains.
+ */
+static bool expand_words(const std::vector<std::string>& tokens, std::vector<std::string>& expanded, \
+    std::set<std::string>& active, std::set<std::string>& suppressed)
+{
+    bool check_next = true;
+    bool trailing_chain = false;
+
+    for(const std::string& token : tokens)
+    {
+        trailing_chain = false;
+
+        if(check_next && alias_table.contains(token))
+        {
+            if(active.count(token) > 0)
+            {
+                suppressed.insert(token);
+                expanded.push_back(token);
+                check_next = false;
+            }
+            else
+            {
+                alias_expansion_t expansion = get_expansion(token, active, suppressed);
+                expanded.insert(expanded.end(), expansion.tokens.begin(), expansion.tokens.end());
+
+                check_next = expansion.chain;
+                trailing_chain = expansion.chain;
+
+                if(!expansion.tokens.empty() && is_command_separator(expansion.tokens.back()))
+                    check_next = true;
+            }
+        }
+        else
+        {
+            expanded.push_back(token);
+            check_next = is_command_separator(token);
+        }
+    }
+
+    return trailing_chain;
+}
+
+
+/*
+ * Returns the fully expanded tokens of an alias. The result is only
+ * memoized if it does not depend on which other aliases were being
+ * expanded at the time, since those are not expanded again.
+ */
+static alias_expansion_t get_expansion(const std::string& name, std::set<std::string>& active, \
+    std::set<std::string>& suppressed)
+{
+    if(expansion_cache.contains(name))
+        return expansion_cache[name];
+
+    std::string value = alias_table[name];
+    std::set<std::string> local_suppressed;
+    alias_expansion_t expansion;
+
+    active.insert(name);
+    bool trailing_chain = expand_words(split_words(value), expansion.tokens, active, local_suppressed);
+    active.erase(name);
+
+    bool ends_with_blank = !value.empty() && (value.back() == ' ' || value.back() == '\t');
+    expansion.chain = ends_with_blank || trailing_chain;
+
+    // suppressing the alias itself does not depend on the caller
+    local_suppressed.erase(name);
+
+    if(local_suppressed.empty())
+        expansion_cache.insert(name, expansion);
+    else
+        suppressed.insert(local_suppressed.begin(), local_suppressed.end());
+
+    return expansion;
+}
+
+
+
+void set_alias(std::string name, std::string value)
+{
+    // a script that is sourced again defines the same aliases again
+    if(alias_table.contains(name) && alias_table.get(name) == value)
+        return;
+
+    alias_table.remove(name);
+    alias_table.insert(name, value);
+    expansion_cache.clear();
+    alias_generation++;
+}
+
+
+bool remove_alias(std::string name)
+{
+    if(!alias_table.contains(name))
+        return false;
+
+    alias_table.remove(name);
+    expansion_cache.clear();
+    alias_generation++;
+    return true;
+}
+
+
+void remove_all_aliases()
+{
+    alias_table.clear();
+    expansion_cache.clear();
+    alias_generation++;
+}
+
+
+unsigned long get_alias_generation()
+{
+    return alias_generation;
+}
+
+
+std::vector<std::string> expand_aliases(const std::vector<std::string>& tokens)
+{
+    std::vector<std::string> expanded;
+    std::set<std::string> active;
+    std::set<std::string> suppressed;
+
+    expand_words(tokens, expanded, active, suppressed);
+
+    return expanded;
+}
@@ -7,17 +7,30 @@
  */
 
 
-#include <iostream>
 #include <string>
+#include <vector>
 
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <sys/wait.h>
 
 
+#include <affinity.h>
+#include <alias.h>
+#include <completion.h>
+#include <history.h>
+#include <line_editor.h>
 #include <main.h>
+#include <output.h>
 #include <parse.h>
+#include <plugin.h>
+#include <priority.h>
+#include <prompt.h>
+#include <resource_limits.h>
+#include <script.h>
+#include <stats.h>
 
 #define MAX_PATHNAME_LENGTH 128
 
@@ -57,7 +70,7 @@ BUILTIN_TABLE int do_builtin_cd(int argc, std::string argv[])
 {
     if(argc > 2 || argc < 0)
     {
-        std::cout << "Incorrect number of arguments to cd" << std::endl;
+        print_error("Incorrect number of arguments to cd");
         return -1;
     }
 
@@ -67,7 +80,9 @@ BUILTIN_TABLE int do_builtin_cd(int argc, std::string argv[])
     
     if(argc == 1)
     {
-        arg = (char*) "~";
+        arg = getenv("HOME");
+        if(arg == NULL)
+            arg = (char*) "/";
     }
     else
     {
@@ -80,53 +95,55 @@ BUILTIN_TABLE int do_builtin_cd(int argc, std::string argv[])
 
     if(retval == 0)
     {
+        update_prompt_directory();
         return 0;
     }
 
-    std::cout << strerror(errno) << std::endl;
+    print_error(strerror(errno));
     
     return -1;
 }
 
 
+/*
+ * Runs a script in the current shell process so that it can change the
+ * state of the shell (working directory, environment, aliases, etc.).
+ * Parsed scripts are cached, so sourcing an unchanged file is cheap.
+ */
 BUILTIN_TABLE int do_builtin_dot(int argc, std::string argv[])
 {
-    if(argc == 0)
+    if(argc < 2)
     {
-        std::cout << "Incorrect number of arguments to ./" << std::endl;
+        print_error("Incorrect format to source. Correct usage: source FILENAME");
         return -1;
     }
 
-    // convert to C style argv
-    char *args[argc];
-    cpp_args_to_c_args(args, argc, argv);
+    return source_script(argv[1]);
+}
 
-    pid_t pid = fork();
-    int status;
 
-    // error
-    if(pid == -1)
-    {
-        std::cout << strerror(errno) << std::endl;
-        return -1;
-    }
-
-    // child process
-    else if(pid == 0)
-    {
-        execvp(args[0], args);
-        std::cout << strerror(errno) << std::endl;
-        _exit(1);
-    }
+/*
+ * exec with only redirections changes the shell's own file descriptors
+ * ('exec 3>> log', 'exec 3>&-'). The redirections were already made
+ * permanent by the time this runs. With a command, the shell is replaced
+ * by it.
+ */
+BUILTIN_TABLE int do_builtin_exec(int argc, std::string argv[])
+{
+    if(argc == 1)
+        return 0;
 
-    else
-    {
-        waitpid(pid, &status, 0);
-    }
+    char *args[argc];
+    cpp_args_to_c_args(args, argc-1, argv+1);
+    args[argc-1] = NULL;
 
-    free_all_args(argc, args);
+    flush_all_output();
+    restore_terminal();
+    execvp(args[0], args);
 
-    return 0;
+    print_error(argv[1] + ": " + strerror(errno));
+    free_all_args(argc-1, args);
+    return -1;
 }
 
 
@@ -134,17 +151,18 @@ BUILTIN_TABLE int do_builtin_exit(int argc, std::string argv[])
 {
     if(argc > 1 || argc < 0)
     {
-        std::cout << "Incorrect number of arguments to exit" << std::endl;
+        print_error("Incorrect number of arguments to exit");
         return -1;
     }
 
     if(argc == 1)
     {
         const char *arg = argv[0].c_str();
-        _exit(atoi(arg));
+        shell_exit(atoi(arg));
     }
 
-    _exit(0);
+    shell_exit(0);
+    return 0;
 }
 
 
@@ -152,7 +170,7 @@ BUILTIN_TABLE int do_builtin_export(int argc, std::string argv[])
 {
     if(argc != 2)
     {
-        std::cout << "Incorrect format to export. Correct usage: export VARNAME=VALUE" << std::endl;
+        print_error("Incorrect format to export. Correct usage: export VARNAME=VALUE");
         return -1;
     }
 
@@ -160,15 +178,19 @@ BUILTIN_TABLE int do_builtin_export(int argc, std::string argv[])
 
     if(tokens.size() != 2)
     {
-        std::cout << "Incorrect format to export. Correct usage: export VARNAME=VALUE" << std::endl;
+        print_error("Incorrect format to export. Correct usage: export VARNAME=VALUE");
         return -1;
     }
 
     if(setenv(tokens[0].c_str(), tokens[1].c_str(), 1) == -1)
     {
-        std::cout << strerror(errno) << std::endl;
+        print_error(strerror(errno));
     }
 
+    // the command index is built from the PATH, so it must be rebuilt
+    if(tokens[0].compare("PATH") == 0)
+        rebuild_command_index();
+
     return 0;
 }
 
@@ -177,25 +199,52 @@ BUILTIN_TABLE int do_builtin_pwd(int argc, std::string argv[])
 {
     if(argc != 1)
     {
-        std::cout << "Incorrect number of arguments to pwd" << std::endl;
+        print_error("Incorrect number of arguments to pwd");
         return -1;
     }
 
     char buf[MAX_PATHNAME_LENGTH];
     if (getcwd(buf, MAX_PATHNAME_LENGTH) == NULL)
     {
-        std::cout << strerror(errno) << std::endl;
+        print_error(strerror(errno));
         return -1;
     }
 
-    std::cout << buf << std::endl;
+    print_output(buf);
+    return 0;
+}
+
+
+/*
+ * ulimit prints or sets the shell's resource limits, which every command
+ * it starts inherits. To limit a single command, use the limit prefix.
+ */
+BUILTIN_TABLE int do_builtin_ulimit(int argc, std::string argv[])
+{
+    std::vector<std::string> args(argv, argv + argc);
+    limit_arguments_t arguments;
+
+    int next = parse_limit_arguments(args, 1, false, arguments);
+    if(next < 0)
+        return -1;
+
+    if(next != argc)
+    {
+        print_error("Incorrect format for ulimit. Correct usage: ulimit [-SHa] [-cdflmnstuv [LIMIT|unlimited]]...");
+        return -1;
+    }
+
+    if(set_limits(arguments) != 0)
+        return -1;
+
+    print_limits(arguments);
     return 0;
 }
 
 
 BUILTIN_TABLE int do_builtin_umask(int argc, std::string argv[])
 {
-    std::cout << "Not implemented..." << std::endl;
+    print_error("Not implemented...");
     return -1;
 }
 
@@ -203,16 +252,35 @@ BUILTIN_TABLE int do_builtin_unset(int argc, std::string argv[])
 {
     if(argc != 2)
     {
-        std::cout << "Incorrect format for unset. Correct usage: unset VARNAME" << std::endl;
+        print_error("Incorrect format for unset. Correct usage: unset VARNAME");
         return -1;
     }
 
     if(unsetenv(argv[1].c_str()) == -1)
     {
-        std::cout << strerror(errno) << std::endl;
+        print_error(strerror(errno));
+        return -1;
+    }
+
+    if(argv[1].compare("PATH") == 0)
+        rebuild_command_index();
+
+    return 0;
+}
+
+
+/*
+ * wait waits for every background job, including coprocesses, to finish.
+ */
+BUILTIN_TABLE int do_builtin_wait(int argc, std::string argv[])
+{
+    if(argc != 1)
+    {
+        print_error("Incorrect format for wait. Correct usage: wait");
         return -1;
     }
 
+    wait_for_background_jobs();
     return 0;
 }
 
@@ -223,23 +291,181 @@ BUILTIN_TABLE int do_builtin_unset(int argc, std::string argv[])
  * Builtins inherited from Bourne again shell *
  **********************************************/
 
+/*
+ * alias with no arguments prints every alias. 'alias NAME' prints a single
+ * alias and 'alias NAME=VALUE' defines one. Since the tokenizer splits on
+ * spaces, the rest of the arguments are joined back together to form the
+ * value, and surrounding quotes are removed.
+ */
 BUILTIN_TABLE int do_builtin_alias(int argc, std::string argv[])
 {
-    std::cout << "Not implemented..." << std::endl;
-    return -1;
+    if(argc == 1)
+    {
+        for(auto it = alias_table.begin(); it != alias_table.end(); ++it)
+        {
+            print_output("alias " + it->first + "='" + it->second + "'");
+        }
+        return 0;
+    }
+
+    size_t equals = argv[1].find('=');
+
+    if(equals == std::string::npos)
+    {
+        if(!alias_table.contains(argv[1]))
+        {
+            print_error("alias: " + argv[1] + ": not found");
+            return -1;
+        }
+
+        print_output("alias " + argv[1] + "='" + alias_table[argv[1]] + "'");
+        return 0;
+    }
+
+    std::string definition = argv[1];
+    for(int i = 2; i < argc; i++)
+    {
+        definition += " " + argv[i];
+    }
+
+    std::string name = definition.substr(0, equals);
+    std::string value = definition.substr(equals+1);
+
+    if(name.empty())
+    {
+        print_error("Incorrect format to alias. Correct usage: alias NAME=VALUE");
+        return -1;
+    }
+
+    if(value.size() >= 2 && (value[0] == '\'' || value[0] == '"') && value.back() == value[0])
+    {
+        value = value.substr(1, value.size()-2);
+    }
+
+    set_alias(name, value);
+    return 0;
 }
 
 
+/*
+ * echo prints its arguments separated by spaces. With -n, no newline is
+ * printed after them.
+ */
 BUILTIN_TABLE int do_builtin_echo(int argc, std::string argv[])
 {
-    std::cout << "Not implemented..." << std::endl;
+    int first = 1;
+    bool newline = true;
+
+    if(argc > 1 && argv[1].compare("-n") == 0)
+    {
+        newline = false;
+        first = 2;
+    }
+
+    std::string line;
+    for(int i = first; i < argc; i++)
+    {
+        if(i > first)
+            line += " ";
+        line += argv[i];
+    }
+
+    if(newline)
+        line += "\n";
+
+    write_output(STDOUT_FILENO, line);
+    return 0;
+}
+
+
+/*
+ * enable lists the builtins, loads builtins from a shared object with
+ * 'enable -f file.so name...', and removes loaded builtins with
+ * 'enable -d name...'.
+ */
+BUILTIN_TABLE int do_builtin_enable(int argc, std::string argv[])
+{
+    if(argc == 1)
+    {
+        print_builtins();
+        return 0;
+    }
+
+    if(argv[1].compare("-f") == 0)
+    {
+        if(argc < 4)
+        {
+            print_error("Incorrect format to enable. Correct usage: enable -f FILE NAME...");
+            return -1;
+        }
+
+        int retval = 0;
+        for(int i = 3; i < argc; i++)
+        {
+            if(load_builtin_plugin(argv[2], argv[i]) != 0)
+                retval = -1;
+        }
+
+        return retval;
+    }
+
+    if(argv[1].compare("-d") == 0)
+    {
+        if(argc < 3)
+        {
+            print_error("Incorrect format to enable. Correct usage: enable -d NAME...");
+            return -1;
+        }
+
+        int retval = 0;
+        for(int i = 2; i < argc; i++)
+        {
+            if(unload_builtin_plugin(argv[i]) != 0)
+                retval = -1;
+        }
+
+        return retval;
+    }
+
+    print_error("Incorrect format to enable. Correct usage: enable [-f FILE NAME...] [-d NAME...]");
     return -1;
 }
 
 
+/*
+ * history prints the numbered history, or only the last N entries with
+ * 'history N'.
+ */
+BUILTIN_TABLE int do_builtin_history(int argc, std::string argv[])
+{
+    if(argc > 2)
+    {
+        print_error("Incorrect number of arguments to history");
+        return -1;
+    }
+
+    int length = history_length();
+    int first = 0;
+
+    if(argc == 2)
+    {
+        int count = atoi(argv[1].c_str());
+        if(count < length)
+            first = length - count;
+    }
+
+    for(int i = first; i < length; i++)
+    {
+        print_output("  " + std::to_string(i+1) + "  " + history_entry(i));
+    }
+
+    return 0;
+}
+
+
 BUILTIN_TABLE int do_builtin_kill(int argc, std::string argv[])
 {
-    std::cout << "Not implemented..." << std::endl;
+    print_error("Not implemented...");
     return -1;
 }
 
@@ -254,8 +480,29 @@ BUILTIN_TABLE int do_builtin_source(int argc, std::string argv[])
 
 BUILTIN_TABLE int do_builtin_unalias(int argc, std::string argv[])
 {
-    std::cout << "Not implemented..." << std::endl;
-    return -1;
+    if(argc < 2)
+    {
+        print_error("Incorrect format to unalias. Correct usage: unalias [-a] NAME...");
+        return -1;
+    }
+
+    if(argv[1].compare("-a") == 0)
+    {
+        remove_all_aliases();
+        return 0;
+    }
+
+    int retval = 0;
+    for(int i = 1; i < argc; i++)
+    {
+        if(!remove_alias(argv[i]))
+        {
+            print_error("unalias: " + argv[i] + ": not found");
+            retval = -1;
+        }
+    }
+
+    return retval;
 }
 
 
@@ -266,21 +513,127 @@ BUILTIN_TABLE int do_builtin_unalias(int argc, std::string argv[])
 
 BUILTIN_TABLE int do_builtin_bg(int argc, std::string argv[])
 {
-    std::cout << "Not implemented..." << std::endl;
+    print_error("Not implemented...");
     return -1;
 }
 
 
+/*
+ * fg waits for a background job (the most recent one, or %N or N), after
+ * giving it back the shell's CPU and I/O priority. The shell has no job
+ * control, so the job keeps the terminal it already shared.
+ */
 BUILTIN_TABLE int do_builtin_fg(int argc, std::string argv[])
 {
-    std::cout << "Not implemented..." << std::endl;
-    return -1;
+    if(argc > 2)
+    {
+        print_error("Incorrect format for fg. Correct usage: fg [%JOB]");
+        return -1;
+    }
+
+    int job_number = 0;
+
+    if(argc == 2)
+    {
+        std::string number = (argv[1][0] == '%') ? argv[1].substr(1) : argv[1];
+
+        if(number.empty() || number.size() > 9 || number.find_first_not_of("0123456789") != std::string::npos)
+        {
+            print_error("fg: " + argv[1] + ": not a job number");
+            return -1;
+        }
+
+        job_number = atoi(number.c_str());
+    }
+
+    if(foreground_job(job_number) != 0)
+    {
+        print_error("fg: " + (argc == 2 ? argv[1] : std::string("current")) + ": no such job");
+        return -1;
+    }
+
+    return 0;
 }
 
 
 BUILTIN_TABLE int do_builtin_jobs(int argc, std::string argv[])
 {
-    std::cout << "Not implemented..." << std::endl;
+    print_error("Not implemented...");
     return -1;
 }
 
+
+
+/***************************
+ * Shell-specific Builtins *
+ ***************************/
+
+/*
+ * bgpriority sets how much background jobs are deprioritized, or prints
+ * the policy with no arguments.
+ */
+BUILTIN_TABLE int do_builtin_bgpriority(int argc, std::string argv[])
+{
+    if(argc == 1)
+    {
+        print_background_policy(background_policy());
+        return 0;
+    }
+
+    std::vector<std::string> args(argv, argv + argc);
+    background_policy_t policy = background_policy();
+
+    if(parse_background_policy(args, policy) != 0)
+        return -1;
+
+    background_policy() = policy;
+    return 0;
+}
+
+
+/*
+ * pin with no command sets the placement of every command the shell starts
+ * from then on, and prints it with no options. Followed by a command it is
+ * a prefix, which the shell applies in that command's process instead.
+ */
+BUILTIN_TABLE int do_builtin_pin(int argc, std::string argv[])
+{
+    if(argc == 1)
+    {
+        print_placement(default_placement());
+        return 0;
+    }
+
+    std::vector<std::string> args(argv, argv + argc);
+    placement_t placement = default_placement();
+
+    int next = parse_placement_arguments(args, 1, true, placement);
+    if(next < 0)
+        return -1;
+
+    if(next != argc)
+    {
+        print_error("Incorrect format for pin. Correct usage: pin [-o] [-s] [-c CPUS] [-m NODES] [command...]");
+        return -1;
+    }
+
+    default_placement() = placement;
+    return 0;
+}
+
+
+/*
+ * stats prints the shell's counters and latency histograms, and with
+ * --json prints them as a single line of JSON for other tools to read.
+ */
+BUILTIN_TABLE int do_builtin_stats(int argc, std::string argv[])
+{
+    if(argc > 2 || (argc == 2 && argv[1].compare("--json") != 0))
+    {
+        print_error("Incorrect format for stats. Correct usage: stats [--json]");
+        return -1;
+    }
+
+    print_stats(argc == 2);
+    return 0;
+}
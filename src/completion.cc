@@ -0,0 +1,563 @@
+/*
+ * File: completion.cc
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * This file implements command and file name completion. The command
+ * index is owned by a background thread: it scans the PATH once into a
+ * fresh trie without holding any lock and then swaps it in, after which
+ * it applies inotify events for the PATH directories one name at a time.
+ * The completion code only holds the lock for the length of a prefix
+ * lookup.
+ */
+
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <sys/syscall.h>
+#endif
+
+
+#include <completion.h>
+#include <descriptors.h>
+#include <hashtable.h>
+#include <main.h>
+#include <trie.h>
+
+
+#define DIRECTORY_BUFFER_SIZE 32768
+
+// inotify events that can change which executables a PATH directory holds
+#define PATH_WATCH_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB \
+    | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+
+typedef struct
+{
+    std::string name;
+    bool is_directory;
+    bool is_executable;
+} directory_entry_t;
+
+
+typedef struct
+{
+    struct timespec mtime;
+    std::vector<directory_entry_t> entries;
+} cached_directory_t;
+
+
+// command index shared with the background thread
+static std::mutex command_index_mutex;
+static std::unique_ptr<Trie> command_index;
+
+// writing to this pipe tells the background thread to rescan the PATH
+static int rebuild_pipe[2] = {-1, -1};
+
+/*
+ * the PATH for the background thread to scan. Only the main thread reads
+ * the environment, since setenv and unsetenv may change it at any time,
+ * so it copies PATH here whenever it asks for a scan
+ */
+static std::mutex index_path_mutex;
+static std::string index_path;
+static bool index_path_set = false;
+
+// directory listings used for file name completion, only used by the main thread
+static Table<std::string, cached_directory_t> directory_cache;
+
+
+
+/*
+ * Wrapper for the modification time field of struct stat, which has a
+ * different name on Mac OSX than on Linux.
+ */
+static struct timespec get_mtime(struct stat& file_stat)
+{
+#if defined(__APPLE__) || defined(__MACH__)
+    return file_stat.st_mtimespec;
+#else
+    return file_stat.st_mtim;
+#endif
+}
+
+
+/*
+ * Fills in the type of an entry whose type could not be taken from the
+ * directory listing itself (symbolic links and file systems without d_type).
+ */
+static void resolve_entry(int dir_fd, directory_entry_t& entry, bool check_executable)
+{
+    struct stat entry_stat;
+
+    if(fstatat(dir_fd, entry.name.c_str(), &entry_stat, 0) == 0)
+        entry.is_directory = S_ISDIR(entry_stat.st_mode);
+
+    if(check_executable && !entry.is_directory)
+        entry.is_executable = (faccessat(dir_fd, entry.name.c_str(), X_OK, 0) == 0);
+}
+
+
+static void add_entry(int dir_fd, const char *name, unsigned char type, bool check_executable, \
+    std::vector<directory_entry_t>& entries)
+{
+    if(strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+        return;
+
+    directory_entry_t entry;
+    entry.name = name;
+    entry.is_directory = (type == DT_DIR);
+    entry.is_executable = false;
+
+    if(type == DT_LNK || type == DT_UNKNOWN || (check_executable && type != DT_DIR))
+        resolve_entry(dir_fd, entry, check_executable);
+
+    entries.push_back(entry);
+}
+
+
+/*
+ * Reads every entry of a directory. On Linux the getdents64 system call
+ * is used directly with a large buffer, which takes far fewer system calls
+ * than readdir for the big directories found on the PATH. If
+ * check_executable is set, each non-directory is also checked for execute
+ * permission. Returns -1 if the directory could not be opened.
+ */
+static int read_directory(const std::string& path, bool check_executable, std::vector<directory_entry_t>& entries)
+{
+#if defined(__linux__)
+    int dir_fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(dir_fd < 0)
+        return -1;
+
+    struct linux_dirent64
+    {
+        ino64_t d_ino;
+        off64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[];
+    };
+
+    char buf[DIRECTORY_BUFFER_SIZE];
+    long nread;
+
+    while((nread = syscall(SYS_getdents64, dir_fd, buf, sizeof(buf))) > 0)
+    {
+        for(long offset = 0; offset < nread;)
+        {
+            struct linux_dirent64 *dirent = (struct linux_dirent64*) (buf + offset);
+            add_entry(dir_fd, dirent->d_name, dirent->d_type, check_executable, entries);
+            offset += dirent->d_reclen;
+        }
+    }
+
+    close(dir_fd);
+#else
+    DIR *dir = opendir(path.c_str());
+    if(dir == NULL)
+        return -1;
+
+    struct dirent *dirent;
+    while((dirent = readdir(dir)) != NULL)
+    {
+        add_entry(dirfd(dir), dirent->d_name, dirent->d_type, check_executable, entries);
+    }
+
+    closedir(dir);
+#endif
+
+    return 0;
+}
+
+
+static std::vector<std::string> get_path_directories(const std::string& path_list)
+{
+    std::vector<std::string> directories;
+    size_t start = 0;
+
+    while(true)
+    {
+        size_t end = path_list.find(':', start);
+        std::string directory = path_list.substr(start, (end == std::string::npos) ? end : end - start);
+
+        // an empty entry is the current directory, as it is for execvp
+        directories.push_back(directory.empty() ? "." : directory);
+
+        if(end == std::string::npos)
+            break;
+
+        start = end + 1;
+    }
+
+    return directories;
+}
+
+
+
+/******************************
+ * Background command indexer *
+ ******************************/
+
+/*
+ * State owned by the background thread. Each PATH directory remembers the
+ * executables it contributed so that an event (or the directory going away)
+ * only touches those names, and so that applying an event for a name that
+ * was already picked up by the scan does nothing.
+ */
+typedef struct
+{
+    int inotify_fd;
+    Table<int, std::string> watches;
+    Table<std::string, std::set<std::string>> directory_names;
+} indexer_state_t;
+
+
+static void index_name(indexer_state_t& state, Trie& index, const std::string& directory, const std::string& name)
+{
+    std::set<std::string>& names = state.directory_names.getReference(directory);
+
+    if(names.insert(name).second)
+        index.insert(name);
+}
+
+
+static void unindex_name(indexer_state_t& state, Trie& index, const std::string& directory, const std::string& name)
+{
+    std::set<std::string>& names = state.directory_names.getReference(directory);
+
+    if(names.erase(name) > 0)
+        index.remove(name);
+}
+
+
+/*
+ * Scans every PATH directory into a new trie. Watches are added before
+ * each directory is read so that no change can slip in between the two.
+ */
+static Trie *scan_path(indexer_state_t& state)
+{
+    Trie *index = new Trie();
+    std::vector<std::string> directories;
+
+    {
+        std::lock_guard<std::mutex> lock(index_path_mutex);
+        if(index_path_set)
+            directories = get_path_directories(index_path);
+    }
+
+    for(std::string directory : directories)
+    {
+        if(state.directory_names.contains(directory))
+            continue;
+
+#if defined(__linux__)
+        int wd = inotify_add_watch(state.inotify_fd, directory.c_str(), PATH_WATCH_EVENTS);
+        if(wd >= 0)
+            state.watches.insert(wd, directory);
+#endif
+
+        state.directory_names.insert(directory, std::set<std::string>());
+
+        std::vector<directory_entry_t> entries;
+        if(read_directory(directory, true, entries) != 0)
+            continue;
+
+        for(directory_entry_t& entry : entries)
+        {
+            if(entry.is_executable)
+                index_name(state, *index, directory, entry.name);
+        }
+    }
+
+    return index;
+}
+
+
+#if defined(__linux__)
+/*
+ * Applies a batch of inotify events to the shared index. New or changed
+ * names are checked for execute permission, since an IN_ATTRIB event may
+ * have added or removed it.
+ */
+static void apply_events(indexer_state_t& state, char *buf, ssize_t length)
+{
+    std::lock_guard<std::mutex> lock(command_index_mutex);
+
+    for(ssize_t offset = 0; offset < length;)
+    {
+        struct inotify_event *event = (struct inotify_event*) (buf + offset);
+        offset += sizeof(struct inotify_event) + event->len;
+
+        if(!state.watches.contains(event->wd))
+            continue;
+
+        std::string directory = state.watches[event->wd];
+
+        if(event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+        {
+            std::set<std::string> names = state.directory_names.get(directory);
+            for(const std::string& name : names)
+                unindex_name(state, *command_index, directory, name);
+
+            continue;
+        }
+
+        if(event->len == 0)
+            continue;
+
+        std::string name = event->name;
+        std::string full_path = directory + "/" + name;
+        struct stat entry_stat;
+
+        bool executable = (event->mask & (IN_CREATE | IN_MOVED_TO | IN_ATTRIB)) \
+            && stat(full_path.c_str(), &entry_stat) == 0 && !S_ISDIR(entry_stat.st_mode) \
+            && access(full_path.c_str(), X_OK) == 0;
+
+        if(executable)
+            index_name(state, *command_index, directory, name);
+        else
+            unindex_name(state, *command_index, directory, name);
+    }
+}
+#endif
+
+
+static void command_index_thread()
+{
+    while(true)
+    {
+        indexer_state_t state;
+        state.inotify_fd = -1;
+
+#if defined(__linux__)
+        state.inotify_fd = move_to_shell_fd(inotify_init1(IN_CLOEXEC));
+#endif
+
+        Trie *index = scan_path(state);
+
+        {
+            std::lock_guard<std::mutex> lock(command_index_mutex);
+            command_index.reset(index);
+        }
+
+        // wait for changes until asked to rescan
+        bool rebuild = false;
+        while(!rebuild)
+        {
+            struct pollfd pfds[2];
+            pfds[0].fd = rebuild_pipe[0];
+            pfds[0].events = POLLIN;
+            pfds[1].fd = state.inotify_fd;
+            pfds[1].events = POLLIN;
+
+            if(poll(pfds, (state.inotify_fd >= 0) ? 2 : 1, -1) < 0)
+            {
+                if(errno == EINTR)
+                    continue;
+                return;
+            }
+
+            if(pfds[0].revents & POLLIN)
+            {
+                char drain[64];
+                read(rebuild_pipe[0], drain, sizeof(drain));
+                rebuild = true;
+            }
+
+#if defined(__linux__)
+            if(state.inotify_fd >= 0 && (pfds[1].revents & POLLIN))
+            {
+                char buf[DIRECTORY_BUFFER_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+                ssize_t length = read(state.inotify_fd, buf, sizeof(buf));
+
+                if(length > 0)
+                    apply_events(state, buf, length);
+            }
+#endif
+        }
+
+        if(state.inotify_fd >= 0)
+            close(state.inotify_fd);
+    }
+}
+
+
+// called by the main thread before every scan it asks for
+static void copy_path_for_index()
+{
+    const char *path = getenv("PATH");
+
+    std::lock_guard<std::mutex> lock(index_path_mutex);
+    index_path_set = (path != NULL);
+    index_path = (path != NULL) ? path : "";
+}
+
+
+void start_command_index()
+{
+    if(rebuild_pipe[0] >= 0)
+        return;
+
+    copy_path_for_index();
+
+    if(pipe(rebuild_pipe) != 0)
+        return;
+
+    rebuild_pipe[0] = move_to_shell_fd(rebuild_pipe[0]);
+    rebuild_pipe[1] = move_to_shell_fd(rebuild_pipe[1]);
+
+    std::thread indexer(command_index_thread);
+    indexer.detach();
+}
+
+
+void rebuild_command_index()
+{
+    if(rebuild_pipe[1] < 0)
+        return;
+
+    copy_path_for_index();
+
+    char c = 0;
+    write(rebuild_pipe[1], &c, 1);
+}
+
+
+
+/**************
+ * Completion *
+ **************/
+
+/*
+ * Returns the listing of a directory, reading it again only if its
+ * modification time has changed since it was cached.
+ */
+static std::vector<directory_entry_t>& get_directory(const std::string& path)
+{
+    static std::vector<directory_entry_t> empty;
+    struct stat dir_stat;
+
+    if(stat(path.c_str(), &dir_stat) != 0)
+    {
+        empty.clear();
+        return empty;
+    }
+
+    struct timespec mtime = get_mtime(dir_stat);
+
+    if(directory_cache.contains(path))
+    {
+        cached_directory_t& cached = directory_cache.getReference(path);
+
+        if(cached.mtime.tv_sec == mtime.tv_sec && cached.mtime.tv_nsec == mtime.tv_nsec)
+            return cached.entries;
+
+        directory_cache.remove(path);
+    }
+
+    cached_directory_t cached;
+    cached.mtime = mtime;
+    read_directory(path, false, cached.entries);
+
+    directory_cache.insert(path, cached);
+    return directory_cache.getReference(path).entries;
+}
+
+
+static std::vector<std::string> complete_command(const std::string& prefix)
+{
+    std::vector<std::string> candidates;
+
+    {
+        std::lock_guard<std::mutex> lock(command_index_mutex);
+        if(command_index)
+            candidates = command_index->withPrefix(prefix);
+    }
+
+    initialize_builtin_table();
+    for(auto it = builtin_table.begin(); it != builtin_table.end(); ++it)
+    {
+        if(it->first.compare(0, prefix.size(), prefix) == 0)
+            candidates.push_back(it->first);
+    }
+
+    for(auto it = alias_table.begin(); it != alias_table.end(); ++it)
+    {
+        if(it->first.compare(0, prefix.size(), prefix) == 0)
+            candidates.push_back(it->first);
+    }
+
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+    return candidates;
+}
+
+
+static std::vector<std::string> complete_file(const std::string& word)
+{
+    std::vector<std::string> candidates;
+
+    size_t slash = word.rfind('/');
+    std::string directory_part = (slash == std::string::npos) ? "" : word.substr(0, slash+1);
+    std::string prefix = (slash == std::string::npos) ? word : word.substr(slash+1);
+
+    std::string directory = directory_part.empty() ? "." : directory_part;
+
+    // expand a leading ~/ for the lookup but keep it in the completed word
+    if(directory_part.compare(0, 2, "~/") == 0 && getenv("HOME") != NULL)
+        directory = std::string(getenv("HOME")) + directory_part.substr(1);
+
+    for(const directory_entry_t& entry : get_directory(directory))
+    {
+        // hidden files are only offered when asked for
+        if(entry.name[0] == '.' && (prefix.empty() || prefix[0] != '.'))
+            continue;
+
+        if(entry.name.compare(0, prefix.size(), prefix) != 0)
+            continue;
+
+        candidates.push_back(directory_part + entry.name + (entry.is_directory ? "/" : ""));
+    }
+
+    std::sort(candidates.begin(), candidates.end());
+    return candidates;
+}
+
+
+std::vector<std::string> complete_word(const std::string& line, size_t cursor, size_t& word_start)
+{
+    word_start = cursor;
+    while(word_start > 0 && line[word_start-1] != ' ')
+        word_start--;
+
+    std::string word = line.substr(word_start, cursor - word_start);
+
+    // the word is a command name if nothing but a command separator comes before it
+    size_t previous = line.find_last_not_of(' ', (word_start > 0) ? word_start-1 : 0);
+    bool command_position = (word_start == 0 || previous == std::string::npos \
+        || strchr("|;&", line[previous]) != NULL);
+
+    if(command_position && word.find('/') == std::string::npos)
+        return complete_command(word);
+
+    return complete_file(word);
+}
@@ -0,0 +1,62 @@
+/*
+ * File: descriptors.cc
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * This file implements moving the shell's own descriptors out of the way
+ * of the user's, and saving and restoring descriptors around redirected
+ * builtins.
+ */
+
+
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+
+
+#include <descriptors.h>
+
+
+
+int move_to_shell_fd(int fd)
+{
+    if(fd < 0)
+        return fd;
+
+    if(fd >= USER_FD_LIMIT)
+    {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        return fd;
+    }
+
+    int moved = fcntl(fd, F_DUPFD_CLOEXEC, USER_FD_LIMIT);
+    if(moved < 0)
+        return fd;
+
+    close(fd);
+    return moved;
+}
+
+
+int save_fd(int fd)
+{
+    return fcntl(fd, F_DUPFD_CLOEXEC, USER_FD_LIMIT);
+}
+
+
+void restore_fd(int fd, int saved)
+{
+    if(saved < 0)
+    {
+        close(fd);
+        return;
+    }
+
+    dup2(saved, fd);
+    close(saved);
+}
+
+
+bool is_fd_open(int fd)
+{
+    return fcntl(fd, F_GETFD) >= 0 || errno != EBADF;
+}
@@ -0,0 +1,398 @@
+/*
+ * File: fork_server.cc
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * This file implements the fork server. The shell and the server are
+ * connected by a Unix socket. For every command the shell sends a request
+ * with the command's descriptors attached (SCM_RIGHTS), followed by the
+ * arguments and the environment, and the server replies with the pid of
+ * the command it started.
+ */
+
+
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+
+#include <descriptors.h>
+#include <fork_server.h>
+#include <job.h>
+#include <output.h>
+#include <stats.h>
+
+
+extern char **environ;
+
+
+/*
+ * The fixed part of a request. The descriptors attached to it are the
+ * ones in targets, in the same order, followed by the working directory.
+ * The arguments and then the environment follow as size bytes of
+ * NUL-terminated strings.
+ */
+typedef struct
+{
+    uint32_t umask;
+    uint32_t size;
+    uint32_t num_args;
+    uint32_t num_env;
+    uint32_t num_fds;
+    int targets[USER_FD_LIMIT];
+} spawn_request_t;
+
+
+// the shell's end of the socket, and the process that may use it
+static int server_socket = -1;
+static pid_t server_owner = -1;
+
+
+
+/*
+ * Sends all of the data on the socket. Returns false if the other end is
+ * gone, without raising SIGPIPE.
+ */
+static bool send_all(int fd, const char *data, size_t length)
+{
+    while(length > 0)
+    {
+        ssize_t written = send(fd, data, length, MSG_NOSIGNAL);
+
+        if(written < 0 && errno == EINTR)
+            continue;
+        if(written <= 0)
+            return false;
+
+        data += written;
+        length -= written;
+    }
+
+    return true;
+}
+
+
+static bool read_all(int fd, char *data, size_t length)
+{
+    while(length > 0)
+    {
+        ssize_t got = read(fd, data, length);
+
+        if(got < 0 && errno == EINTR)
+            continue;
+        if(got <= 0)
+            return false;
+
+        data += got;
+        length -= got;
+    }
+
+    return true;
+}
+
+
+static void add_strings(std::string& payload, char **strings, uint32_t& count)
+{
+    for(count = 0; strings != NULL && strings[count] != NULL; count++)
+    {
+        payload += strings[count];
+        payload += '\0';
+    }
+}
+
+
+
+/**********
+ * Server *
+ **********/
+
+#if defined(__linux__)
+
+/*
+ * Forks a process that is a child of the shell rather than of the server.
+ */
+static pid_t fork_for_shell()
+{
+    return syscall(SYS_clone, CLONE_PARENT | SIGCHLD, 0, 0, 0, 0);
+}
+
+
+/*
+ * Runs in the new process: puts every descriptor where the shell had it,
+ * changes to the shell's directory, takes the shell's umask, and execs the
+ * command.
+ */
+static void exec_request(int sock, spawn_request_t& request, int *fds, char **args, char **env)
+{
+    close(sock);
+
+    signal(SIGINT, SIG_DFL);
+    signal(SIGQUIT, SIG_DFL);
+    signal(SIGTSTP, SIG_DFL);
+
+    // move the received descriptors out of the way of the ones they become
+    for(uint32_t i = 0; i < request.num_fds; i++)
+    {
+        int moved = fcntl(fds[i], F_DUPFD_CLOEXEC, USER_FD_LIMIT);
+        close(fds[i]);
+        fds[i] = moved;
+    }
+
+    for(int fd = 0; fd < USER_FD_LIMIT; fd++)
+        close(fd);
+
+    for(uint32_t i = 0; i+1 < request.num_fds; i++)
+        dup2(fds[i], request.targets[i]);
+
+    if(fchdir(fds[request.num_fds-1]) != 0)
+    {
+        print_error(strerror(errno));
+        flush_all_output();
+        _exit(1);
+    }
+
+    umask(request.umask);
+    environ = env;
+    count_stat(STAT_EXECS);
+    execvp(args[0], args);
+
+    int error = errno;
+    count_stat(STAT_EXEC_FAILURES);
+
+    if(exec_failure_status(error) == 127)
+        print_error("Command not found...");
+    else
+        print_error(std::string(args[0]) + ": " + strerror(error));
+
+    flush_all_output();
+    _exit(exec_failure_status(error));
+}
+
+
+/*
+ * Receives a request and the descriptors attached to it. Returns false
+ * once the shell has closed its end of the socket.
+ */
+static bool receive_request(int sock, spawn_request_t& request, int *fds, std::vector<char>& payload)
+{
+    char control[CMSG_SPACE(sizeof(int) * (USER_FD_LIMIT+1))];
+
+    struct iovec vector;
+    vector.iov_base = &request;
+    vector.iov_len = sizeof(request);
+
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t got;
+    do
+    {
+        got = recvmsg(sock, &message, MSG_CMSG_CLOEXEC);
+    } while(got < 0 && errno == EINTR);
+
+    if(got != sizeof(request))
+        return false;
+
+    uint32_t num_fds = 0;
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    if(header != NULL && header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS)
+    {
+        num_fds = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        memcpy(fds, CMSG_DATA(header), num_fds * sizeof(int));
+    }
+
+    // the working directory must always be there
+    if(num_fds != request.num_fds || num_fds == 0 || num_fds > USER_FD_LIMIT+1)
+        return false;
+
+    payload.resize(request.size);
+    return read_all(sock, payload.data(), payload.size());
+}
+
+
+/*
+ * The server's loop: one command per request, until the shell exits.
+ */
+static void serve(int sock)
+{
+    // a ^C at the terminal is for the command, not for the server
+    signal(SIGINT, SIG_IGN);
+    signal(SIGQUIT, SIG_IGN);
+    signal(SIGTSTP, SIG_IGN);
+
+    spawn_request_t request;
+    int fds[USER_FD_LIMIT+1];
+    std::vector<char> payload;
+
+    while(receive_request(sock, request, fds, payload))
+    {
+        std::vector<char*> strings;
+        for(size_t start = 0; start < payload.size(); start += strlen(&payload[start]) + 1)
+            strings.push_back(&payload[start]);
+
+        pid_t pid = -1;
+
+        if(request.num_args > 0 && strings.size() == request.num_args + request.num_env)
+        {
+            std::vector<char*> args(strings.begin(), strings.begin() + request.num_args);
+            std::vector<char*> env(strings.begin() + request.num_args, strings.end());
+            args.push_back(NULL);
+            env.push_back(NULL);
+
+            pid = fork_for_shell();
+            if(pid == 0)
+                exec_request(sock, request, fds, args.data(), env.data());
+        }
+
+        for(uint32_t i = 0; i < request.num_fds; i++)
+            close(fds[i]);
+
+        if(!send_all(sock, (const char*) &pid, sizeof(pid)))
+            break;
+    }
+
+    _exit(0);
+}
+
+#endif
+
+
+
+int start_fork_server()
+{
+#if defined(__linux__)
+    int sockets[2];
+    if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) != 0)
+    {
+        print_error(strerror(errno));
+        return -1;
+    }
+
+    pid_t pid = fork();
+
+    if(pid < 0)
+    {
+        print_error(strerror(errno));
+        close(sockets[0]);
+        close(sockets[1]);
+        return -1;
+    }
+
+    if(pid == 0)
+    {
+        close(sockets[0]);
+        serve(sockets[1]);
+    }
+
+    close(sockets[1]);
+    server_socket = move_to_shell_fd(sockets[0]);
+    server_owner = getpid();
+
+    return 0;
+#else
+    print_error("The fork server is only available on Linux");
+    return -1;
+#endif
+}
+
+
+bool fork_server_available()
+{
+    return server_socket >= 0 && getpid() == server_owner;
+}
+
+
+pid_t spawn_with_fork_server(char **args)
+{
+    if(!fork_server_available())
+        return -1;
+
+    spawn_request_t request;
+    memset(&request, 0, sizeof(request));
+
+    // the descriptors a forked command would have inherited
+    int fds[USER_FD_LIMIT+1];
+    for(int fd = 0; fd < USER_FD_LIMIT; fd++)
+    {
+        int flags = fcntl(fd, F_GETFD);
+        if(flags >= 0 && !(flags & FD_CLOEXEC))
+        {
+            request.targets[request.num_fds] = fd;
+            fds[request.num_fds++] = fd;
+        }
+    }
+
+    int directory = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(directory < 0)
+        return -1;
+
+    fds[request.num_fds++] = directory;
+
+    // umask can only be read by setting it
+    request.umask = umask(0);
+    umask(request.umask);
+
+    std::string payload;
+    add_strings(payload, args, request.num_args);
+    add_strings(payload, environ, request.num_env);
+    request.size = payload.size();
+
+    char control[CMSG_SPACE(sizeof(fds))];
+    memset(control, 0, sizeof(control));
+
+    struct iovec vector;
+    vector.iov_base = &request;
+    vector.iov_len = sizeof(request);
+
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = CMSG_SPACE(sizeof(int) * request.num_fds);
+
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int) * request.num_fds);
+    memcpy(CMSG_DATA(header), fds, sizeof(int) * request.num_fds);
+
+    ssize_t sent;
+    do
+    {
+        sent = sendmsg(server_socket, &message, MSG_NOSIGNAL);
+    } while(sent < 0 && errno == EINTR);
+
+    close(directory);
+
+    pid_t pid = -1;
+    if(sent != sizeof(request) || !send_all(server_socket, payload.data(), payload.size()) ||
+        !read_all(server_socket, (char*) &pid, sizeof(pid)))
+    {
+        // the server is gone, so every command is forked from now on
+        print_error("The fork server has exited; commands will be forked by the shell");
+        close(server_socket);
+        server_socket = -1;
+        return -1;
+    }
+
+    return pid;
+}
@@ -0,0 +1,331 @@
+/*
+ * File: history.cc
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * This file implements the command history. The history file is mapped
+ * read-only into memory and indexed by the byte offset at which each entry
+ * starts, so entries are never copied out of the mapping until they are
+ * used. When the file grows (because of this session or any other) only
+ * the new tail is indexed. Substring search uses an index from each
+ * n-gram to the entries containing it, which is also built incrementally
+ * and only once the first search is made.
+ */
+
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+
+#include <descriptors.h>
+#include <history.h>
+
+
+static int history_fd = -1;
+
+// the mapped history file and how much of it has been indexed
+static char *history_map = NULL;
+static size_t history_map_size = 0;
+static size_t history_indexed_end = 0;
+
+// byte offset in the file at which each entry starts
+static std::vector<uint64_t> history_offsets;
+
+/*
+ * n-gram index. An unordered_map is used instead of a Table since a large
+ * history has tens of thousands of distinct n-grams and this is built on
+ * the first search. Entry lists are in increasing order.
+ */
+static std::unordered_map<uint32_t, std::vector<uint32_t>> ngram_index;
+static bool ngram_index_built = false;
+static size_t ngram_indexed_entries = 0;
+
+// last command added in this session, used to skip immediate duplicates
+static std::string last_added;
+
+
+
+static int open_history()
+{
+    if(history_fd >= 0)
+        return 0;
+
+    std::string path;
+    const char *histfile = getenv("HISTFILE");
+    const char *home = getenv("HOME");
+
+    if(histfile != NULL)
+        path = histfile;
+    else if(home != NULL)
+        path = std::string(home) + "/" + HISTORY_FILE_NAME;
+    else
+        return -1;
+
+    history_fd = move_to_shell_fd(open(path.c_str(), O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600));
+    return (history_fd >= 0) ? 0 : -1;
+}
+
+
+static uint32_t ngram_at(const char *text)
+{
+    uint32_t ngram = 0;
+
+    for(int i = 0; i < HISTORY_NGRAM_LENGTH; i++)
+        ngram = (ngram << 8) | (unsigned char) text[i];
+
+    return ngram;
+}
+
+
+/*
+ * Returns a pointer to the text of an entry in the mapping and sets
+ * length to its length, not counting the newline.
+ */
+static const char *entry_text(int index, size_t& length)
+{
+    uint64_t start = history_offsets[index];
+    uint64_t end = ((size_t) index + 1 < history_offsets.size()) ? history_offsets[index+1] : history_indexed_end;
+
+    length = end - start - 1;
+    return history_map + start;
+}
+
+
+static void index_ngrams()
+{
+    for(; ngram_indexed_entries < history_offsets.size(); ngram_indexed_entries++)
+    {
+        size_t length;
+        const char *text = entry_text(ngram_indexed_entries, length);
+
+        for(size_t i = 0; i + HISTORY_NGRAM_LENGTH <= length; i++)
+        {
+            std::vector<uint32_t>& entries = ngram_index[ngram_at(text + i)];
+
+            if(entries.empty() || entries.back() != ngram_indexed_entries)
+                entries.push_back(ngram_indexed_entries);
+        }
+    }
+}
+
+
+/*
+ * Unmaps the history file and forgets every entry indexed from it, so that
+ * the next refresh indexes the file from the start.
+ */
+static void reset_history()
+{
+    if(history_map != NULL)
+        munmap(history_map, history_map_size);
+
+    history_map = NULL;
+    history_map_size = 0;
+    history_indexed_end = 0;
+    history_offsets.clear();
+
+    ngram_index.clear();
+    ngram_indexed_entries = 0;
+}
+
+
+/*
+ * Maps the history file again if it has grown and indexes every complete
+ * entry that was added since the last time. Called on every access, so
+ * in the common case it is a single fstat.
+ */
+static void refresh_history()
+{
+    if(open_history() != 0)
+        return;
+
+    struct stat history_stat;
+    if(fstat(history_fd, &history_stat) != 0)
+        return;
+
+    /*
+     * another shell truncated the file. Reading the pages of the mapping
+     * past its new end would raise SIGBUS, so it is mapped and indexed
+     * again from the start
+     */
+    if((size_t) history_stat.st_size < history_map_size)
+        reset_history();
+
+    if((size_t) history_stat.st_size <= history_map_size)
+        return;
+
+    if(history_map != NULL)
+        munmap(history_map, history_map_size);
+
+    history_map_size = history_stat.st_size;
+    history_map = (char*) mmap(NULL, history_map_size, PROT_READ, MAP_SHARED, history_fd, 0);
+
+    if(history_map == MAP_FAILED)
+    {
+        history_map = NULL;
+        reset_history();
+        return;
+    }
+
+    // an entry without its newline yet is left for the next refresh
+    while(history_indexed_end < history_map_size)
+    {
+        char *start = history_map + history_indexed_end;
+        char *newline = (char*) memchr(start, '\n', history_map_size - history_indexed_end);
+
+        if(newline == NULL)
+            break;
+
+        history_offsets.push_back(history_indexed_end);
+        history_indexed_end += newline - start + 1;
+    }
+
+    if(ngram_index_built)
+        index_ngrams();
+}
+
+
+
+void add_history(const std::string& line)
+{
+    if(line.empty() || line == last_added)
+        return;
+
+    if(open_history() != 0)
+        return;
+
+    // a single write with O_APPEND keeps records from different sessions whole
+    std::string record = line + "\n";
+    ssize_t written;
+
+    do
+    {
+        written = write(history_fd, record.data(), record.size());
+    } while(written < 0 && errno == EINTR);
+
+    last_added = line;
+}
+
+
+int history_length()
+{
+    refresh_history();
+    return history_offsets.size();
+}
+
+
+std::string history_entry(int index)
+{
+    if(index < 0 || (size_t) index >= history_offsets.size())
+        return "";
+
+    size_t length;
+    const char *text = entry_text(index, length);
+
+    return std::string(text, length);
+}
+
+
+/*
+ * Short queries are matched with a scan of the entries. Longer queries
+ * pick the n-gram of the query with the fewest entries and only check
+ * those entries.
+ */
+int search_history(const std::string& query, int before)
+{
+    refresh_history();
+
+    if(before > (int) history_offsets.size())
+        before = history_offsets.size();
+
+    if(query.size() < HISTORY_NGRAM_LENGTH)
+    {
+        for(int i = before-1; i >= 0; i--)
+        {
+            size_t length;
+            const char *text = entry_text(i, length);
+
+            if(memmem(text, length, query.data(), query.size()) != NULL)
+                return i;
+        }
+
+        return -1;
+    }
+
+    if(!ngram_index_built)
+    {
+        ngram_index_built = true;
+        index_ngrams();
+    }
+
+    const std::vector<uint32_t> *candidates = NULL;
+
+    for(size_t i = 0; i + HISTORY_NGRAM_LENGTH <= query.size(); i++)
+    {
+        auto it = ngram_index.find(ngram_at(query.data() + i));
+        if(it == ngram_index.end())
+            return -1;
+
+        if(candidates == NULL || it->second.size() < candidates->size())
+            candidates = &it->second;
+    }
+
+    // entry lists are sorted, so skip straight to the entries before 'before'
+    auto it = std::lower_bound(candidates->begin(), candidates->end(), (uint32_t) before);
+
+    while(it != candidates->begin())
+    {
+        --it;
+
+        size_t length;
+        const char *text = entry_text(*it, length);
+
+        if(memmem(text, length, query.data(), query.size()) != NULL)
+            return *it;
+    }
+
+    return -1;
+}
+
+
+bool expand_history(std::string& line)
+{
+    if(line.size() < 2 || line[0] != '!')
+        return true;
+
+    int length = history_length();
+
+    if(line.compare("!!") == 0)
+    {
+        if(length == 0)
+            return false;
+
+        line = history_entry(length-1);
+        return true;
+    }
+
+    std::string prefix = line.substr(1);
+
+    for(int i = length-1; i >= 0; i--)
+    {
+        size_t entry_length;
+        const char *text = entry_text(i, entry_length);
+
+        if(entry_length >= prefix.size() && memcmp(text, prefix.data(), prefix.size()) == 0)
+        {
+            line = std::string(text, entry_length);
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -9,11 +9,13 @@
 
 
 #include <stdbool.h>
-#include <iostream>
+#include <ostream>
 #include <vector>
 #include <string>
 #include <exception>
 
+#include <errno.h>
+
 
 #include <job.h>
 
@@ -164,6 +166,7 @@ Command::~Command()
     _inputFiles.clear();
     _outputFiles.clear();
     _errorFiles.clear();
+    _fdRedirections.clear();
     _tokenArray.clear();
 }
 
@@ -240,6 +243,18 @@ void Command::addErrorFile(std::string errorFile)
 }
 
 
+std::vector<fd_redirection_t>& Command::getFdRedirections()
+{
+    return _fdRedirections;
+}
+
+
+void Command::addFdRedirection(const fd_redirection_t& redirection)
+{
+    _fdRedirections.push_back(redirection);
+}
+
+
 // numTokens has no setter. set when token array is set
 int Command::getNumTokens()
 {
@@ -313,6 +328,26 @@ void operator<<(std::ostream& out, Command& command)
 }
 
 
+void make_args(Command& command, char **args, int num_args)
+{
+    std::vector<std::string>& tokens = command.getTokenArray();
+
+    for(int j = 0; j < num_args; j++)
+        args[j] = (char*) tokens[j].c_str();
+
+    args[num_args] = NULL;
+}
+
+
+int exec_failure_status(int error)
+{
+    if(error == ENOENT || error == ENOTDIR)
+        return 127;
+
+    return 126;
+}
+
+
 /**************************
  * 
  **************************/
@@ -340,6 +375,9 @@ Job::Job(bool background, int numCommands, const std::vector<Command>& commands)
 Job::~Job()
 {
     _commands.clear();
+    _processSubstitutions.clear();
+    _pids.clear();
+    _coprocessFds.clear();
 }
 
 
@@ -373,3 +411,81 @@ void Job::addCommand(const Command& command)
     _numCommands++;
 }
 
+
+std::vector<process_substitution_t>& Job::getProcessSubstitutions()
+{
+    return _processSubstitutions;
+}
+
+
+void Job::addProcessSubstitution(const process_substitution_t& substitution)
+{
+    _processSubstitutions.push_back(substitution);
+}
+
+
+std::vector<pid_t>& Job::getPids()
+{
+    return _pids;
+}
+
+
+void Job::addPid(pid_t pid)
+{
+    _pids.push_back(pid);
+}
+
+
+std::vector<coprocess_fd_t>& Job::getCoprocessFds()
+{
+    return _coprocessFds;
+}
+
+
+void Job::addCoprocessFd(const coprocess_fd_t& coprocessFd)
+{
+    _coprocessFds.push_back(coprocessFd);
+}
+
+
+
+/**************************
+ * 
+ **************************/
+
+
+JobList::JobList()
+{
+}
+
+
+JobList::~JobList()
+{
+    _jobs.clear();
+    _conditions.clear();
+}
+
+
+int JobList::getNumJobs()
+{
+    return _jobs.size();
+}
+
+
+std::vector<Job>& JobList::getJobs()
+{
+    return _jobs;
+}
+
+
+std::vector<run_condition_t>& JobList::getConditions()
+{
+    return _conditions;
+}
+
+
+void JobList::addJob(const Job& job, run_condition_t condition)
+{
+    _jobs.push_back(job);
+    _conditions.push_back(condition);
+}
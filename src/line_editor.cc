@@ -0,0 +1,1084 @@
+/*
+ * File: line_editor.cc
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * This file implements the line editor that reads commands from the
+ * terminal. Input is read straight from file descriptor 0 into a buffer
+ * and every key in the buffer is processed before anything is written,
+ * so the echo for a whole paste is sent to the terminal in one write.
+ * Edits only redraw the part of the line after the cursor, using relative
+ * cursor movement escape sequences. A line wider than the terminal wraps
+ * onto the rows below, so the cursor is kept track of as a column count
+ * from the start of the prompt's last line, which the terminal's width
+ * turns into a row and a column.
+ */
+
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+
+
+#include <history.h>
+#include <line_editor.h>
+
+
+// how long to wait for the rest of an escape sequence before treating ESC as a key
+#define ESCAPE_TIMEOUT_MS 50
+
+#define CTRL_KEY(k) ((k) & 0x1f)
+#define ESCAPE_KEY 0x1b
+#define BACKSPACE_KEY 0x7f
+
+// width of the tab stops that tabs in a paste are expanded to
+#define TAB_WIDTH 8
+
+// assumed when the terminal does not report its size
+#define DEFAULT_TERMINAL_WIDTH 80
+
+
+// input buffer shared by both the terminal and the non-terminal readers
+static char input_buffer[LINE_EDITOR_BUFFER_SIZE];
+static size_t input_start = 0;
+static size_t input_end = 0;
+
+// input buffer for batch mode, which never shares its input with the editor
+static char batch_buffer[BATCH_BUFFER_SIZE];
+static size_t batch_start = 0;
+static size_t batch_end = 0;
+
+// pending terminal output, written in one go before blocking on input
+static std::string output_buffer;
+
+static struct termios original_termios;
+static bool termios_saved = false;
+
+static completion_function_t completion_function = NULL;
+
+
+/*
+ * The line being edited along with the byte offset of the cursor in it.
+ */
+typedef struct
+{
+    std::string prompt;
+
+    // the part of the prompt after its last newline, which is all that is
+    // drawn again, and the number of columns it takes
+    std::string prompt_line;
+    int prompt_columns;
+    int terminal_columns;
+
+    std::string line;
+    size_t cursor;
+    bool last_key_was_tab;
+
+    // index of the history entry being shown, or -1 for the new line
+    int history_index;
+    std::string saved_line;
+} edit_state_t;
+
+
+
+/*********************************
+ * Terminal and buffer management *
+ *********************************/
+
+void restore_terminal()
+{
+    if(termios_saved)
+        tcsetattr(STDIN_FILENO, TCSADRAIN, &original_termios);
+}
+
+
+/*
+ * Puts the terminal into raw mode so every key is delivered as it is
+ * typed and nothing is echoed by the terminal driver. Output processing
+ * is left on so that '\n' still moves to the start of the next line.
+ * TCSADRAIN is used so that anything typed ahead is not thrown away.
+ */
+static int enable_raw_mode()
+{
+    if(!termios_saved)
+    {
+        if(tcgetattr(STDIN_FILENO, &original_termios) != 0)
+            return -1;
+
+        termios_saved = true;
+        atexit(restore_terminal);
+    }
+
+    struct termios raw = original_termios;
+    raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    raw.c_cflag |= CS8;
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+
+    return tcsetattr(STDIN_FILENO, TCSADRAIN, &raw);
+}
+
+
+static void flush_output()
+{
+    size_t written = 0;
+
+    while(written < output_buffer.size())
+    {
+        ssize_t n = write(STDOUT_FILENO, output_buffer.data() + written, output_buffer.size() - written);
+
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            break;
+
+        written += n;
+    }
+
+    output_buffer.clear();
+}
+
+
+/*
+ * Refills the input buffer once it has been used up. Returns the number
+ * of bytes read, 0 on end of file, and -1 on error.
+ */
+static ssize_t fill_input()
+{
+    ssize_t n;
+
+    do
+    {
+        n = read(STDIN_FILENO, input_buffer, LINE_EDITOR_BUFFER_SIZE);
+    } while(n < 0 && errno == EINTR);
+
+    input_start = 0;
+    input_end = (n > 0) ? n : 0;
+
+    return n;
+}
+
+
+/*
+ * Blocks until the next input byte is available and returns it, or -1 on
+ * end of file.
+ */
+static int next_byte()
+{
+    if(input_start == input_end)
+    {
+        flush_output();
+
+        if(fill_input() <= 0)
+            return -1;
+    }
+
+    return (unsigned char) input_buffer[input_start++];
+}
+
+
+/*
+ * Returns the next input byte for an escape sequence, waiting briefly for
+ * it to arrive if the buffer is empty. Returns -1 if nothing arrives.
+ */
+static int next_escape_byte()
+{
+    if(input_start == input_end)
+    {
+        flush_output();
+
+        struct pollfd pfd;
+        pfd.fd = STDIN_FILENO;
+        pfd.events = POLLIN;
+
+        if(poll(&pfd, 1, ESCAPE_TIMEOUT_MS) <= 0 || fill_input() <= 0)
+            return -1;
+    }
+
+    return (unsigned char) input_buffer[input_start++];
+}
+
+
+
+/**********************
+ * Cursor and redraws *
+ **********************/
+
+static bool is_continuation_byte(char c)
+{
+    return (c & 0xc0) == 0x80;
+}
+
+
+// number of terminal columns taken by a range of a UTF-8 string
+static int columns(const std::string& text, size_t from, size_t to)
+{
+    int count = 0;
+
+    for(size_t i = from; i < to; i++)
+    {
+        if(!is_continuation_byte(text[i]))
+            count++;
+    }
+
+    return count;
+}
+
+
+// like columns, but skips the escape sequences that colour a prompt
+static int prompt_columns(const std::string& prompt)
+{
+    int count = 0;
+
+    for(size_t i = 0; i < prompt.size(); i++)
+    {
+        if(prompt[i] == ESCAPE_KEY && i+1 < prompt.size() && prompt[i+1] == '[')
+        {
+            i += 2;
+            while(i < prompt.size() && (prompt[i] < 0x40 || prompt[i] > 0x7e))
+                i++;
+        }
+        else if(!is_continuation_byte(prompt[i]))
+            count++;
+    }
+
+    return count;
+}
+
+
+static int terminal_width()
+{
+    struct winsize window;
+
+    if(ioctl(STDOUT_FILENO, TIOCGWINSZ, &window) == 0 && window.ws_col > 0)
+        return window.ws_col;
+
+    return DEFAULT_TERMINAL_WIDTH;
+}
+
+
+// column of a byte offset in the line, counted from the start of the prompt's last line
+static int position_of(edit_state_t& state, size_t offset)
+{
+    return state.prompt_columns + columns(state.line, 0, offset);
+}
+
+
+static void cursor_left(int n)
+{
+    if(n == 1)
+        output_buffer += '\b';
+    else if(n > 1)
+        output_buffer += "\x1b[" + std::to_string(n) + "D";
+}
+
+
+static void cursor_right(int n)
+{
+    if(n > 0)
+        output_buffer += "\x1b[" + std::to_string(n) + "C";
+}
+
+
+static void cursor_up(int n)
+{
+    if(n > 0)
+        output_buffer += "\x1b[" + std::to_string(n) + "A";
+}
+
+
+static void cursor_down(int n)
+{
+    if(n > 0)
+        output_buffer += "\x1b[" + std::to_string(n) + "B";
+}
+
+
+/*
+ * Moves the cursor between two positions (see position_of), which are on
+ * different rows if the line wraps between them.
+ */
+static void move_cursor(edit_state_t& state, int from, int to)
+{
+    int width = state.terminal_columns;
+    int rows = to / width - from / width;
+
+    if(rows == 0)
+    {
+        if(to < from)
+            cursor_left(from - to);
+        else
+            cursor_right(to - from);
+
+        return;
+    }
+
+    if(rows < 0)
+        cursor_up(-rows);
+    else
+        cursor_down(rows);
+
+    output_buffer += '\r';
+    cursor_right(to % width);
+}
+
+
+/*
+ * Called after text has been written up to the given position. If that
+ * filled the last column of a row, the terminal leaves the cursor there
+ * until the next character is written, so it is moved to the start of the
+ * next row to be where the position says it is.
+ */
+static void finish_row(edit_state_t& state, int position)
+{
+    if(position > 0 && position % state.terminal_columns == 0)
+        output_buffer += '\n';
+}
+
+
+/*
+ * Redraws everything from the cursor to the end of the line, clears
+ * whatever was left over from the old line, and puts the cursor back.
+ */
+static void redraw_tail(edit_state_t& state)
+{
+    int end = position_of(state, state.line.size());
+
+    if(state.cursor < state.line.size())
+    {
+        output_buffer.append(state.line, state.cursor, std::string::npos);
+        finish_row(state, end);
+    }
+
+    output_buffer += "\x1b[J";
+    move_cursor(state, end, position_of(state, state.cursor));
+}
+
+
+/*
+ * Draws the prompt's last line and the whole line again. from is where
+ * the cursor is now, so that drawing starts on the prompt's row.
+ */
+static void redraw_line(edit_state_t& state, int from)
+{
+    cursor_up(from / state.terminal_columns);
+    state.terminal_columns = terminal_width();
+
+    output_buffer += '\r';
+    output_buffer += state.prompt_line;
+    output_buffer.append(state.line, 0, state.cursor);
+
+    if(state.cursor == state.line.size())
+        finish_row(state, position_of(state, state.cursor));
+
+    redraw_tail(state);
+}
+
+
+
+/*****************
+ * Edit commands *
+ *****************/
+
+/*
+ * Inserts a run of printable bytes at the cursor. Appending at the end of
+ * the line, which is the usual case, only echoes the new text.
+ */
+static void insert_text(edit_state_t& state, const char *text, size_t length)
+{
+    if(state.cursor == state.line.size())
+    {
+        state.line.append(text, length);
+        state.cursor += length;
+        output_buffer.append(text, length);
+        finish_row(state, position_of(state, state.cursor));
+        return;
+    }
+
+    state.line.insert(state.cursor, text, length);
+    output_buffer.append(text, length);
+    state.cursor += length;
+    redraw_tail(state);
+}
+
+
+/*
+ * Inserts a run of pasted text, in which tabs are expanded to spaces so
+ * that they are not taken for completion and every column is accounted for.
+ */
+static void insert_pasted_text(edit_state_t& state, const char *text, size_t length)
+{
+    if(memchr(text, '\t', length) == NULL)
+    {
+        insert_text(state, text, length);
+        return;
+    }
+
+    std::string expanded;
+    int column = columns(state.line, 0, state.cursor);
+
+    for(size_t i = 0; i < length; i++)
+    {
+        if(text[i] == '\t')
+        {
+            int spaces = TAB_WIDTH - column % TAB_WIDTH;
+            expanded.append(spaces, ' ');
+            column += spaces;
+            continue;
+        }
+
+        expanded += text[i];
+        if(!is_continuation_byte(text[i]))
+            column++;
+    }
+
+    insert_text(state, expanded.data(), expanded.size());
+}
+
+
+// removes the bytes between from and the cursor, which must be before it
+static void delete_before_cursor(edit_state_t& state, size_t from)
+{
+    if(from >= state.cursor)
+        return;
+
+    move_cursor(state, position_of(state, state.cursor), position_of(state, from));
+
+    state.line.erase(from, state.cursor - from);
+    state.cursor = from;
+
+    if(state.cursor == state.line.size())
+        output_buffer += "\x1b[J";
+    else
+        redraw_tail(state);
+}
+
+
+static size_t previous_char(edit_state_t& state)
+{
+    size_t position = state.cursor;
+
+    while(position > 0)
+    {
+        position--;
+        if(!is_continuation_byte(state.line[position]))
+            break;
+    }
+
+    return position;
+}
+
+
+static size_t next_char(edit_state_t& state)
+{
+    size_t position = state.cursor;
+
+    if(position < state.line.size())
+        position++;
+
+    while(position < state.line.size() && is_continuation_byte(state.line[position]))
+        position++;
+
+    return position;
+}
+
+
+static size_t previous_word(edit_state_t& state)
+{
+    size_t position = state.cursor;
+
+    while(position > 0 && state.line[position-1] == ' ')
+        position--;
+
+    while(position > 0 && state.line[position-1] != ' ')
+        position--;
+
+    return position;
+}
+
+
+static void delete_at_cursor(edit_state_t& state)
+{
+    if(state.cursor == state.line.size())
+        return;
+
+    state.line.erase(state.cursor, next_char(state) - state.cursor);
+    redraw_tail(state);
+}
+
+
+static void move_to(edit_state_t& state, size_t position)
+{
+    move_cursor(state, position_of(state, state.cursor), position_of(state, position));
+    state.cursor = position;
+}
+
+
+/*
+ * Prints the candidates in columns below the line being edited and then
+ * redraws the prompt and line underneath them. Asks first if there are
+ * too many to be useful.
+ */
+static void list_candidates(edit_state_t& state, const std::vector<std::string>& candidates)
+{
+    move_cursor(state, position_of(state, state.cursor), position_of(state, state.line.size()));
+    output_buffer += '\n';
+
+    if(candidates.size() > LINE_EDITOR_QUERY_ITEMS)
+    {
+        output_buffer += "Display all " + std::to_string(candidates.size()) + " possibilities? (y or n)";
+
+        int answer = next_byte();
+        output_buffer += '\n';
+
+        if(answer != 'y' && answer != 'Y')
+        {
+            redraw_line(state, 0);
+            return;
+        }
+    }
+
+    size_t width = 0;
+    for(const std::string& candidate : candidates)
+        width = std::max(width, candidate.size() + 2);
+
+    size_t per_row = std::max((size_t) 1, terminal_width() / width);
+
+    for(size_t i = 0; i < candidates.size(); i++)
+    {
+        output_buffer += candidates[i];
+
+        if(i % per_row == per_row-1 || i == candidates.size()-1)
+            output_buffer += '\n';
+        else
+            output_buffer.append(width - candidates[i].size(), ' ');
+    }
+
+    redraw_line(state, 0);
+}
+
+
+/*
+ * Completes the word before the cursor. The word is extended to the
+ * longest prefix shared by every candidate, and a unique candidate is
+ * finished off with a space (unless it is a directory). Pressing Tab
+ * again when nothing more can be added lists the candidates.
+ */
+static void complete(edit_state_t& state)
+{
+    if(completion_function == NULL)
+        return;
+
+    size_t word_start;
+    std::vector<std::string> candidates = completion_function(state.line, state.cursor, word_start);
+
+    if(candidates.empty())
+    {
+        output_buffer += '\a';
+        return;
+    }
+
+    std::string common = candidates[0];
+    for(const std::string& candidate : candidates)
+    {
+        size_t length = 0;
+        while(length < common.size() && length < candidate.size() && common[length] == candidate[length])
+            length++;
+
+        common.resize(length);
+    }
+
+    size_t word_length = state.cursor - word_start;
+    std::string word = state.line.substr(word_start, word_length);
+
+    if(common.size() > word_length && common.compare(0, word_length, word) == 0)
+    {
+        std::string addition = common.substr(word_length);
+        insert_text(state, addition.data(), addition.size());
+    }
+    else if(candidates.size() > 1)
+    {
+        if(state.last_key_was_tab)
+            list_candidates(state, candidates);
+        else
+            output_buffer += '\a';
+
+        return;
+    }
+
+    if(candidates.size() == 1 && common.back() != '/')
+        insert_text(state, " ", 1);
+}
+
+
+/*
+ * Replaces the whole line, e.g. with an entry from the history, and puts
+ * the cursor at the end of it.
+ */
+static void set_line(edit_state_t& state, const std::string& line)
+{
+    int from = position_of(state, state.cursor);
+
+    state.line = line;
+    state.cursor = line.size();
+    redraw_line(state, from);
+}
+
+
+static void history_previous(edit_state_t& state)
+{
+    if(state.history_index < 0)
+    {
+        state.history_index = history_length();
+        state.saved_line = state.line;
+    }
+
+    if(state.history_index == 0)
+    {
+        output_buffer += '\a';
+        return;
+    }
+
+    state.history_index--;
+    set_line(state, history_entry(state.history_index));
+}
+
+
+static void history_next(edit_state_t& state)
+{
+    if(state.history_index < 0)
+        return;
+
+    state.history_index++;
+
+    if(state.history_index >= history_length())
+    {
+        state.history_index = -1;
+        set_line(state, state.saved_line);
+        return;
+    }
+
+    set_line(state, history_entry(state.history_index));
+}
+
+
+/*
+ * Draws the search over the prompt and line, starting from the row of the
+ * given position, and returns the position it ends at.
+ */
+static int draw_search(edit_state_t& state, int from, const std::string& query, const std::string& match, bool failed)
+{
+    std::string text = failed ? "(failed reverse-i-search)`" : "(reverse-i-search)`";
+    text += query + "': " + match;
+
+    cursor_up(from / state.terminal_columns);
+    output_buffer += '\r';
+    output_buffer += text;
+
+    int end = columns(text, 0, text.size());
+    finish_row(state, end);
+    output_buffer += "\x1b[J";
+
+    return end;
+}
+
+
+/*
+ * Incremental reverse search through the history (Ctrl-R). Typing
+ * extends the query, Ctrl-R again finds an older match, and Ctrl-G or
+ * Ctrl-C gives up. Any other key accepts the match and is then handled
+ * as usual, so Enter runs the matched command straight away.
+ */
+static void reverse_search(edit_state_t& state)
+{
+    std::string query;
+    std::string match;
+    int match_index = history_length();
+    bool failed = false;
+
+    int position = draw_search(state, position_of(state, state.cursor), query, match, failed);
+
+    while(true)
+    {
+        int c = next_byte();
+        if(c < 0)
+            return;
+
+        if(c == CTRL_KEY('r') || (c >= 0x20 && c != BACKSPACE_KEY) || c == BACKSPACE_KEY)
+        {
+            int before = match_index;
+
+            if(c == BACKSPACE_KEY)
+            {
+                if(!query.empty())
+                    query.pop_back();
+                before = history_length();
+            }
+            else if(c != CTRL_KEY('r'))
+            {
+                // the current match may still match the longer query
+                query += (char) c;
+                before = match_index + 1;
+            }
+
+            int found = query.empty() ? -1 : search_history(query, before);
+            failed = !query.empty() && found < 0;
+
+            if(found >= 0)
+            {
+                match_index = found;
+                match = history_entry(found);
+            }
+
+            position = draw_search(state, position, query, match, failed);
+            continue;
+        }
+
+        if(c == CTRL_KEY('g') || c == CTRL_KEY('c'))
+        {
+            redraw_line(state, position);
+            return;
+        }
+
+        // accept the match and let the editor handle the key
+        if(!match.empty())
+        {
+            state.line = match;
+            state.cursor = match.size();
+        }
+
+        input_start--;
+        redraw_line(state, position);
+        return;
+    }
+}
+
+
+/*
+ * Handles the escape sequences sent by the arrow, Home, End, and Delete
+ * keys. Both the CSI (ESC [) and SS3 (ESC O) forms are accepted.
+ */
+static void handle_escape(edit_state_t& state)
+{
+    int introducer = next_escape_byte();
+    if(introducer != '[' && introducer != 'O')
+        return;
+
+    int parameter = 0;
+    int c = next_escape_byte();
+
+    while(c >= '0' && c <= '9')
+    {
+        parameter = parameter*10 + (c - '0');
+        c = next_escape_byte();
+    }
+
+    // skip any further parameters, e.g. modifier keys
+    while(c == ';' || (c >= '0' && c <= '9'))
+        c = next_escape_byte();
+
+    switch(c)
+    {
+    case 'A':
+        history_previous(state);
+        break;
+    case 'B':
+        history_next(state);
+        break;
+    case 'C':
+        move_to(state, next_char(state));
+        break;
+    case 'D':
+        move_to(state, previous_char(state));
+        break;
+    case 'H':
+        move_to(state, 0);
+        break;
+    case 'F':
+        move_to(state, state.line.size());
+        break;
+    case '~':
+        if(parameter == 1 || parameter == 7)
+            move_to(state, 0);
+        else if(parameter == 4 || parameter == 8)
+            move_to(state, state.line.size());
+        else if(parameter == 3)
+            delete_at_cursor(state);
+        break;
+    default:
+        break;
+    }
+}
+
+
+
+/***************
+ * Line reading *
+ ***************/
+
+/*
+ * Reads a line without any editing, for when standard input is not a
+ * terminal (e.g. a pipe or a file).
+ */
+static bool read_plain_line(std::string& line)
+{
+    line.clear();
+
+    while(true)
+    {
+        if(input_start == input_end)
+        {
+            if(fill_input() <= 0)
+                return !line.empty();
+        }
+
+        char *start = input_buffer + input_start;
+        char *newline = (char*) memchr(start, '\n', input_end - input_start);
+
+        if(newline != NULL)
+        {
+            line.append(start, newline - start);
+            input_start += newline - start + 1;
+            return true;
+        }
+
+        line.append(start, input_end - input_start);
+        input_start = input_end;
+    }
+}
+
+
+// whether the input byte at index is text to be inserted rather than a key
+static bool is_text_byte(size_t index)
+{
+    unsigned char c = input_buffer[index];
+
+    if(c == '\t')
+        return index+1 < input_end;
+
+    return c >= 0x20 && c != BACKSPACE_KEY;
+}
+
+
+static bool read_edited_line(edit_state_t& state)
+{
+    while(true)
+    {
+        if(input_start == input_end)
+        {
+            flush_output();
+
+            if(fill_input() <= 0)
+                return false;
+        }
+
+        unsigned char c = input_buffer[input_start];
+
+        /*
+         * insert the whole run of printable bytes at once. A tab with more
+         * input behind it is part of a paste rather than a request for
+         * completion
+         */
+        if(is_text_byte(input_start))
+        {
+            state.last_key_was_tab = false;
+
+            size_t run_end = input_start + 1;
+            while(run_end < input_end && is_text_byte(run_end))
+                run_end++;
+
+            insert_pasted_text(state, input_buffer + input_start, run_end - input_start);
+            input_start = run_end;
+            continue;
+        }
+
+        input_start++;
+
+        bool tab = (c == '\t');
+
+        switch(c)
+        {
+        case '\r':
+        case '\n':
+            move_to(state, state.line.size());
+            output_buffer += '\n';
+            flush_output();
+            return true;
+
+        case BACKSPACE_KEY:
+        case CTRL_KEY('h'):
+            delete_before_cursor(state, previous_char(state));
+            break;
+
+        case CTRL_KEY('a'):
+            move_to(state, 0);
+            break;
+
+        case CTRL_KEY('e'):
+            move_to(state, state.line.size());
+            break;
+
+        case CTRL_KEY('b'):
+            move_to(state, previous_char(state));
+            break;
+
+        case CTRL_KEY('f'):
+            move_to(state, next_char(state));
+            break;
+
+        case CTRL_KEY('k'):
+            state.line.erase(state.cursor);
+            output_buffer += "\x1b[J";
+            break;
+
+        case CTRL_KEY('u'):
+            delete_before_cursor(state, 0);
+            break;
+
+        case CTRL_KEY('w'):
+            delete_before_cursor(state, previous_word(state));
+            break;
+
+        case CTRL_KEY('l'):
+            output_buffer += "\x1b[H\x1b[2J";
+            redraw_line(state, 0);
+            break;
+
+        // abandon the current line and start over with a fresh prompt
+        case CTRL_KEY('c'):
+            move_to(state, state.line.size());
+            output_buffer += "^C\n";
+            output_buffer += state.prompt;
+            finish_row(state, state.prompt_columns);
+            state.line.clear();
+            state.cursor = 0;
+            break;
+
+        // end of file on an empty line, otherwise delete under the cursor
+        case CTRL_KEY('d'):
+            if(state.line.empty())
+            {
+                output_buffer += '\n';
+                flush_output();
+                return false;
+            }
+            delete_at_cursor(state);
+            break;
+
+        case ESCAPE_KEY:
+            handle_escape(state);
+            break;
+
+        case '\t':
+            complete(state);
+            break;
+
+        case CTRL_KEY('p'):
+            history_previous(state);
+            break;
+
+        case CTRL_KEY('n'):
+            history_next(state);
+            break;
+
+        case CTRL_KEY('r'):
+            reverse_search(state);
+            break;
+
+        default:
+            break;
+        }
+
+        state.last_key_was_tab = tab;
+    }
+}
+
+
+void set_completion_function(completion_function_t function)
+{
+    completion_function = function;
+}
+
+
+bool read_batch_line(std::string& line)
+{
+    line.clear();
+
+    while(true)
+    {
+        char *start = batch_buffer + batch_start;
+        char *newline = (char*) memchr(start, '\n', batch_end - batch_start);
+
+        if(newline != NULL)
+        {
+            line.append(start, newline - start);
+            batch_start += newline - start + 1;
+            return true;
+        }
+
+        line.append(start, batch_end - batch_start);
+
+        ssize_t n;
+        do
+        {
+            n = read(STDIN_FILENO, batch_buffer, BATCH_BUFFER_SIZE);
+        } while(n < 0 && errno == EINTR);
+
+        batch_start = 0;
+        batch_end = (n > 0) ? n : 0;
+
+        if(n <= 0)
+            return !line.empty();
+    }
+}
+
+
+bool read_buffered_batch_line(std::string& line)
+{
+    char *start = batch_buffer + batch_start;
+    char *newline = (char*) memchr(start, '\n', batch_end - batch_start);
+
+    if(newline == NULL)
+        return false;
+
+    line.assign(start, newline - start);
+    batch_start += newline - start + 1;
+    return true;
+}
+
+
+bool read_line(const std::string& prompt, std::string& line)
+{
+    if(!isatty(STDIN_FILENO) || enable_raw_mode() != 0)
+    {
+        output_buffer += prompt;
+        flush_output();
+        return read_plain_line(line);
+    }
+
+    edit_state_t state;
+    state.prompt = prompt;
+    state.prompt_line = prompt.substr(prompt.rfind('\n') + 1);
+    state.prompt_columns = prompt_columns(state.prompt_line);
+    state.terminal_columns = terminal_width();
+    state.cursor = 0;
+    state.last_key_was_tab = false;
+    state.history_index = -1;
+
+    output_buffer += prompt;
+    finish_row(state, state.prompt_columns);
+    bool retval = read_edited_line(state);
+
+    restore_terminal();
+
+    line = state.line;
+    return retval;
+}
@@ -6,7 +6,7 @@
  */
 
 
-#include <iostream>
+#include <stdexcept>
 #include <string>
 
 #include <unistd.h>
@@ -14,28 +14,48 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/stat.h>
 #include <fcntl.h>
+#include <stdio.h>
+#include <time.h>
 
 
+#include <affinity.h>
+#include <alias.h>
 #include <builtin.h>
 #include <builtin_list.h>
+#include <completion.h>
+#include <descriptors.h>
+#include <fork_server.h>
 #include <hashtable.h>
+#include <history.h>
 #include <job.h>
+#include <line_editor.h>
 #include <main.h>
+#include <output.h>
 #include <parse.h>
+#include <priority.h>
+#include <prompt.h>
+#include <redirect.h>
+#include <resource_limits.h>
 #include <signal_handlers.h>
 #include <sighandler_list.h>
+#include <stats.h>
+#include <trace.h>
+#include <watchdog.h>
 
 
-#define MAX_USERNAME_LENGTH 128
-#define MAX_PATH_LENGTH 128
-#define MAX_HOSTNAME_LENGTH 128
+// maximum number of phases reported by --startup-profile
+#define MAX_STARTUP_PHASES 16
 
 
 // various static shell variables
-static char login_name[MAX_USERNAME_LENGTH];
-static char host_name[MAX_HOSTNAME_LENGTH];
 static int next_job_number = 1;
+static bool interactive = false;
+
+// the exit status of the last job ($?), and of each stage of it (PIPESTATUS)
+static int last_status = 0;
+static std::vector<int> pipe_status(1, 0);
 
 
 Table<std::string, std::string> alias_table;
@@ -44,168 +64,966 @@ Table<std::string, builtin_t> builtin_table;
 Table<int, sighandler_t> sighandler_table;
 
 
+
+/***************
+ * Exit status *
+ ***************/
+
+static void set_exit_status(int status)
+{
+    last_status = status;
+    pipe_status.assign(1, status);
+}
+
+
 /*
- * Wrapper function for the getlogin and getlogin_r functions since there are compatibility
- * issues with getlogin_r for Mac OSX but not with Linux.
+ * Sets the exit status of a job from the wait statuses of its stages, as
+ * the shell reaped them. A stage killed by a signal has 128 plus the
+ * signal's number, and one that was never started (because a fork failed)
+ * has 1. The job's own status is that of its last stage.
  */
-int get_login_name(char *buf, size_t buf_size)
+static void set_pipe_status(const std::vector<int>& wait_statuses, int num_stages)
 {
-#if defined(__APPLE__) || defined(__MACH__)
-    buf = getenv("USER");
-#else
-    buf = getenv("USERNAME");
-#endif
+    pipe_status.assign(num_stages, 1);
 
-    return 0;
+    for(size_t i = 0; i < wait_statuses.size() && i < pipe_status.size(); i++)
+    {
+        if(WIFEXITED(wait_statuses[i]))
+            pipe_status[i] = WEXITSTATUS(wait_statuses[i]);
+        else if(WIFSIGNALED(wait_statuses[i]))
+            pipe_status[i] = 128 + WTERMSIG(wait_statuses[i]);
+    }
+
+    last_status = pipe_status.back();
 }
 
 
-std::string make_prompt()
+/*
+ * Replaces '$?' in the words of a job with the exit status of the last
+ * job, '${PIPESTATUS[N]}' with that of its Nth stage (or nothing), and the
+ * word '${PIPESTATUS[@]}' with the status of every stage, one word each.
+ * A list is parsed before any of it runs, so this is done as each job of
+ * it starts.
+ */
+static void expand_exit_status(Job& job)
 {
-    char current_path[MAX_PATH_LENGTH];
-    getcwd(current_path, MAX_PATH_LENGTH);
+    const std::string pipe_status_name = "${PIPESTATUS[";
+
+    for(Command& command : job.getCommands())
+    {
+        std::vector<std::string>& tokens = command.getTokenArray();
+        std::vector<std::string> expanded;
+        bool changed = false;
+
+        for(const std::string& token : tokens)
+        {
+            if(token.find('$') == std::string::npos)
+            {
+                expanded.push_back(token);
+                continue;
+            }
+
+            changed = true;
+
+            if(token.compare(pipe_status_name + "@]}") == 0)
+            {
+                for(int status : pipe_status)
+                    expanded.push_back(std::to_string(status));
+                continue;
+            }
 
-    std::vector<std::string> tok_path = tokenize(current_path, "/");
-    std::string current_dir = tok_path[tok_path.size()-1];
-    std::string login(login_name);
-    std::string hostname(host_name);
-    std::string prompt = login + std::string("@") + hostname + std::string(" ") + current_dir + std::string(" % ");
+            std::string word;
+            size_t i = 0;
 
-    return prompt;
+            while(i < token.size())
+            {
+                size_t close = token.find("]}", i);
+
+                if(token.compare(i, 2, "$?") == 0)
+                {
+                    word += std::to_string(last_status);
+                    i += 2;
+                }
+                else if(token.compare(i, pipe_status_name.size(), pipe_status_name) == 0 && close != std::string::npos)
+                {
+                    std::string index = token.substr(i + pipe_status_name.size(), close - i - pipe_status_name.size());
+
+                    if(!index.empty() && index.size() < 4 && index.find_first_not_of("0123456789") == std::string::npos && \
+                        std::stoul(index) < pipe_status.size())
+                    {
+                        word += std::to_string(pipe_status[std::stoul(index)]);
+                    }
+
+                    i = close + 2;
+                }
+                else
+                    word += token[i++];
+            }
+
+            expanded.push_back(word);
+        }
+
+        if(changed)
+        {
+            tokens.clear();
+            command.setTokenArray(expanded);
+        }
+    }
 }
 
 
+/*
+ * The builtin table is filled in the first time a command is looked up
+ * rather than at startup, so a shell that only runs external commands
+ * never pays for it. Safe to call any number of times.
+ */
 void initialize_builtin_table()
 {
+    static bool initialized = false;
+    if(initialized)
+        return;
+
+    initialized = true;
+
     for(int i = 0; i < num_builtins; i++)
     {
         builtin_table.insert(builtin_commands_list[i], builtin_list[i]);
     }
+
+    // '.' cannot be generated from a function name, so it is added by hand
+    builtin_table.insert(".", do_builtin_dot);
+}
+
+void initialize_sighandler_table()
+{
+    // insert signals and corresponding signal handlers into the table
+    for(int i = 0; i < num_sighandlers; i++)
+    {
+        sighandler_table.insert(signum_list[i], signal_handler_list[i]);
+    }
+
+    // install each signal handler
+    for(auto it = sighandler_table.begin(); it != sighandler_table.end(); ++it)
+    {
+        Signal(it->first, it->second);
+    }
+}
+
+
+/*
+ * Checks if a given command is a builtin command. Used to determine whether
+ * to call execute_builtin or execute_external_command.
+ */
+bool is_builtin(Job& job)
+{
+    if(job.getNumCommands() == 0)
+        return false;
+    
+    Command first_command = job.getCommands()[0];
+    if(first_command.getNumTokens() == 0)
+        return false;
+
+    std::string command_name = job.getCommands()[0].getTokenArray()[0];
+
+    // 'pin' followed by a command is a prefix rather than the builtin
+    if(command_name.compare("pin") == 0 && placement_has_command(first_command.getTokenArray()))
+        return false;
+
+    initialize_builtin_table();
+    bool bi_table_contains = builtin_table.contains(command_name);
+    bool single_command = (job.getNumCommands() == 1);
+    
+    return bi_table_contains && single_command;
+}
+
+
+/*
+ * Executes a given builtin command by accessing builtin table and
+ * calling the function stored there.
+ */
+void execute_builtin(Job& job)
+{
+    std::string command_name = job.getCommands()[0].getTokenArray()[0];
+    builtin_t command_function = builtin_table[command_name];
+    
+    int argc = job.getCommands()[0].getNumTokens();
+    std::string *argv = &job.getCommands()[0].getTokenArray()[0];
+
+    /*
+     * builtins run in the shell itself, so their redirections are undone
+     * when they return, except for exec, which is how they are made permanent
+     */
+    bool permanent = (command_name.compare("exec") == 0);
+    shell_redirection_t saved;
+
+    if(redirect_shell(job.getCommands()[0], permanent ? NULL : &saved) != 0)
+        return;
+
+    count_stat(STAT_BUILTIN_CALLS);
+
+    uint64_t start = trace_start();
+    int result = command_function(argc, argv);
+    trace_span("builtin", start, command_name.c_str());
+
+    set_exit_status(result == 0 ? 0 : 1);
+
+    if(!permanent)
+        restore_shell_redirection(saved);
+}
+
+
+/************************
+ * Process substitution *
+ ************************/
+
+/*
+ * Starts the command of a process substitution connected to a new pipe,
+ * and replaces the token with the /dev/fd path of the shell's end of it.
+ * '<(cmd)' gives the command the output of cmd to read, and '>(cmd)' gives
+ * it the input of cmd to write to.
+ */
+static void start_process_substitution(Job& job, int command_number, std::string& token)
+{
+    bool command_reads = (token[0] == '<');
+
+    int fds[2];
+    if(pipe(fds) != 0)
+    {
+        print_error(strerror(errno));
+        return;
+    }
+
+    int shell_end = command_reads ? fds[0] : fds[1];
+    int child_end = command_reads ? fds[1] : fds[0];
+
+    pid_t pid = fork();
+
+    if(pid < 0)
+    {
+        print_error(strerror(errno));
+        close(fds[0]);
+        close(fds[1]);
+        return;
+    }
+
+    if(pid > 0)
+        count_stat(STAT_FORKS);
+
+    if(pid == 0)
+    {
+        close(shell_end);
+        for(process_substitution_t& substitution : job.getProcessSubstitutions())
+            close(substitution.fd);
+
+        dup2(child_end, command_reads ? STDOUT_FILENO : STDIN_FILENO);
+        close(child_end);
+
+        try
+        {
+            JobList substituted_list = parse_list(expand_aliases(tokenize(get_substituted_command(token), " ")));
+            execute_list(substituted_list);
+        }
+        catch(const std::runtime_error& e)
+        {
+            count_stat(STAT_PARSE_ERRORS);
+            print_error("Parse error. Please enter correct syntax.");
+            set_exit_status(1);
+        }
+
+        // the substitution exits with the status of the list it ran
+        flush_all_output();
+        _exit(last_status);
+    }
+
+    close(child_end);
+
+    // close-on-exec, so only the command it belongs to inherits it
+    process_substitution_t substitution;
+    substitution.command = command_number;
+    substitution.pid = pid;
+    substitution.fd = move_to_shell_fd(shell_end);
+    job.addProcessSubstitution(substitution);
+
+    token = "/dev/fd/" + std::to_string(substitution.fd);
+}
+
+
+static void start_process_substitutions(Job& job, int command_number, std::vector<std::string>& tokens)
+{
+    for(std::string& token : tokens)
+    {
+        if(is_process_substitution(token))
+            start_process_substitution(job, command_number, token);
+    }
+}
+
+
+/*
+ * Starts every process substitution in the job's arguments and redirections.
+ */
+static void start_process_substitutions(Job& job)
+{
+    for(int i = 0; i < job.getNumCommands(); i++)
+    {
+        Command& command = job.getCommands()[i];
+
+        start_process_substitutions(job, i, command.getTokenArray());
+        start_process_substitutions(job, i, command.getInputFiles());
+        start_process_substitutions(job, i, command.getOutputFiles());
+        start_process_substitutions(job, i, command.getErrorFiles());
+
+        for(fd_redirection_t& redirection : command.getFdRedirections())
+        {
+            if(is_process_substitution(redirection.path))
+                start_process_substitution(job, i, redirection.path);
+        }
+    }
+}
+
+
+/*
+ * Called in the child for a command, before it execs, so it keeps the pipes
+ * of its own process substitutions open.
+ */
+static void inherit_process_substitutions(Job& job, int command_number)
+{
+    for(process_substitution_t& substitution : job.getProcessSubstitutions())
+    {
+        if(substitution.command == command_number)
+            fcntl(substitution.fd, F_SETFD, 0);
+    }
+}
+
+
+/*
+ * Closes the shell's ends of the pipes once the commands have them, so
+ * that each side sees the end of file when the other exits. A job in the
+ * foreground also waits for the substituted commands, so that (for
+ * example) everything written to '>(cmd)' has been handled by the time the
+ * next prompt is shown. A background job's are reaped along with it.
+ */
+static void finish_process_substitutions(Job& job)
+{
+    for(process_substitution_t& substitution : job.getProcessSubstitutions())
+        close(substitution.fd);
+
+    if(job.isBackground())
+        return;
+
+    for(process_substitution_t& substitution : job.getProcessSubstitutions())
+    {
+        while(waitpid(substitution.pid, NULL, 0) < 0 && errno == EINTR)
+            ;
+    }
+}
+
+
+/**************
+ * Batch mode *
+ **************/
+
+/*
+ * A line read and parsed ahead of time by prefetch_next_command.
+ */
+typedef struct
+{
+    bool ready;
+    bool parsed;
+    std::string line;
+    JobList list;
+} prefetched_command_t;
+
+static bool prefetch = false;
+static prefetched_command_t prefetched = {false, false, "", JobList()};
+
+// --batch uses batch mode even on a terminal, and with --batch-report the
+// rate commands were run at is printed at exit, however batch mode was chosen
+static bool batch = false;
+static bool batch_report = false;
+static long batch_commands = 0;
+static struct timespec batch_start_time;
+
+// the list the main loop is running, and the job of it that may prefetch
+static JobList *main_loop_list = NULL;
+static Job *main_loop_job = NULL;
+
+
+static void strip_line(std::string& line)
+{
+    line.erase(0, line.find_first_not_of(" \t"));
+    line.erase(line.find_last_not_of(" \t") + 1);
+}
+
+
+/*
+ * Parses the tokens of a command line, expanding aliases first, so that
+ * the aliases defined when the line runs are the ones used. Also used for
+ * the lines of sourced scripts. Returns false if it is not valid syntax.
+ */
+bool parse_tokens(const std::vector<std::string>& tokens, JobList& list)
+{
+    uint64_t parse_start = stats_clock();
+
+    try
+    {
+        uint64_t start = trace_start();
+        std::vector<std::string> expanded = expand_aliases(tokens);
+        trace_span("expand aliases", start);
+
+        start = trace_start();
+        list = parse_list(expanded);
+        trace_span("parse", start);
+    }
+    catch(const std::runtime_error& e)
+    {
+        count_stat(STAT_PARSE_ERRORS);
+        return false;
+    }
+
+    record_stat(STAT_PARSE_TIME, parse_start);
+    return true;
+}
+
+
+static bool parse_line(const std::string& line, JobList& list)
+{
+    uint64_t start = trace_start();
+    std::vector<std::string> tokens = tokenize(line, " ");
+    trace_span("tokenize", start);
+
+    return parse_tokens(tokens, list);
+}
+
+
+/*
+ * Called while a foreground external command is running. With --prefetch,
+ * if the next line has already been read into the batch buffer, it is
+ * parsed now rather than after the command exits. Only lines that are
+ * already buffered are used, so this never waits for input, and only the
+ * main loop's own job prefetches: a command run by a sourced script could
+ * be followed by an alias that changes how the next line parses.
+ */
+static void prefetch_next_command(Job& job)
+{
+    if(!prefetch || prefetched.ready || &job != main_loop_job)
+        return;
+
+    if(!read_buffered_batch_line(prefetched.line))
+        return;
+
+    strip_line(prefetched.line);
+    prefetched.parsed = parse_line(prefetched.line, prefetched.list);
+    prefetched.ready = true;
+}
+
+
+static void print_batch_report()
+{
+    if(!batch_report || interactive)
+        return;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    double seconds = (now.tv_sec - batch_start_time.tv_sec) + (now.tv_nsec - batch_start_time.tv_nsec) / 1e9;
+
+    char report[128];
+    snprintf(report, sizeof(report), "%ld commands in %.3f s, %.0f commands/s", batch_commands, seconds, \
+        seconds > 0 ? batch_commands / seconds : 0.0);
+    print_error(report);
+}
+
+
+/*
+ * Exits the shell, writing out everything it printed first. Used by the
+ * exit builtin so that it also reports the batch rate.
+ */
+void shell_exit(int status)
+{
+    print_batch_report();
+    finish_shell_redirections();
+    finish_tracing();
+    _exit(status);
+}
+
+
+
+/*******************
+ * Background jobs *
+ *******************/
+
+/*
+ * Adds a job that was started in the background (including a coprocess) to
+ * the job table, along with the processes started for it, so that it can be
+ * reaped when it finishes.
+ */
+static void add_background_job(Job& job)
+{
+    job_table.insert(next_job_number, job);
+    next_job_number++;
+}
+
+
+/*
+ * Waits for a process if it has finished, or until it does if wait_all is
+ * set. Returns true once it has been reaped. A process that is not the
+ * shell's child (in a subshell that inherited the job table) counts as
+ * reaped.
+ */
+static bool reap_process(pid_t pid, bool wait_all)
+{
+    pid_t result;
+
+    while((result = waitpid(pid, NULL, wait_all ? 0 : WNOHANG)) < 0 && errno == EINTR)
+        ;
+
+    if(result == 0)
+        return false;
+
+    if(result > 0)
+        trace_exit(result);
+
+    return true;
+}
+
+
+/*
+ * Waits for the processes of a background job that have finished, or for
+ * all of them if wait_all is set, including the commands of its process
+ * substitutions. Returns true once every one of them has been reaped.
+ */
+static bool reap_job(Job& job, bool wait_all)
+{
+    std::vector<pid_t>& pids = job.getPids();
+
+    for(size_t i = 0; i < pids.size(); )
+    {
+        if(reap_process(pids[i], wait_all))
+            pids.erase(pids.begin() + i);
+        else
+            i++;
+    }
+
+    // a background job leaves its substitutions for the job table to reap
+    std::vector<process_substitution_t>& substitutions = job.getProcessSubstitutions();
+
+    for(size_t i = 0; i < substitutions.size(); )
+    {
+        if(reap_process(substitutions[i].pid, wait_all))
+            substitutions.erase(substitutions.begin() + i);
+        else
+            i++;
+    }
+
+    if(!pids.empty() || !substitutions.empty())
+        return false;
+
+    /*
+     * nothing can be written to a coprocess that has exited. The end it
+     * writes to stays open, so what it printed before exiting can still be
+     * read.
+     */
+    for(coprocess_fd_t& coprocess_fd : job.getCoprocessFds())
+    {
+        struct stat info;
+        if(fstat(coprocess_fd.fd, &info) == 0 && info.st_ino == coprocess_fd.pipe)
+            close(coprocess_fd.fd);
+    }
+
+    return true;
+}
+
+
+static void reap_jobs(bool wait_all)
+{
+    std::vector<int> finished;
+
+    for(auto& entry : job_table)
+    {
+        if(reap_job(entry.second, wait_all))
+            finished.push_back(entry.first);
+    }
+
+    for(int job_number : finished)
+    {
+        job_table.remove(job_number);
+
+        if(interactive)
+            print_output("[" + std::to_string(job_number) + "] Done");
+    }
+
+    if(job_table.begin() == job_table.end())
+        next_job_number = 1;
+}
+
+
+/*
+ * Reaps the background jobs that have finished. Called before every job,
+ * so that no finished job is left as a zombie for long.
+ */
+void reap_background_jobs()
+{
+    reap_jobs(false);
+}
+
+
+/*
+ * Waits for every background job to finish. Used by the wait builtin.
+ */
+void wait_for_background_jobs()
+{
+    reap_jobs(true);
+}
+
+
+/*
+ * Brings a background job (the most recent one if job_number is 0) to the
+ * foreground: gives its processes the shell's priority back and waits for
+ * it to finish. Used by the fg builtin. Returns -1 if there is no such job.
+ */
+int foreground_job(int job_number)
+{
+    if(job_number == 0)
+    {
+        for(auto& entry : job_table)
+            job_number = entry.first;
+    }
+
+    if(!job_table.contains(job_number))
+        return -1;
+
+    Job& job = job_table.getReference(job_number);
+
+    // if one process cannot be restored, neither can the others, so that is
+    // only reported once
+    bool report = true;
+    for(pid_t pid : job.getPids())
+    {
+        if(restore_priority(pid, report) != 0)
+            report = false;
+    }
+
+    reap_job(job, true);
+    job_table.remove(job_number);
+
+    if(job_table.begin() == job_table.end())
+        next_job_number = 1;
+
+    return 0;
+}
+
+
+/*
+ * A process of a background job lowers its own priority before it execs,
+ * and the shell waits until it has, on a pipe that the child closes. That
+ * way a fg straight after the job cannot restore the priority before the
+ * child has lowered it, and nothing the job starts escapes the policy.
+ */
+static void open_priority_handshake(Job& job, int ready[2])
+{
+    if(!job.isBackground() || !background_policy().enabled || pipe(ready) != 0)
+        ready[0] = ready[1] = -1;
+}
+
+
+static void child_priority_handshake(int ready[2])
+{
+    if(ready[0] < 0)
+        return;
+
+    apply_background_policy();
+    close(ready[0]);
+    close(ready[1]);
+}
+
+
+static void parent_priority_handshake(int ready[2])
+{
+    if(ready[0] < 0)
+        return;
+
+    close(ready[1]);
+
+    char byte;
+    while(read(ready[0], &byte, 1) < 0 && errno == EINTR)
+        ;
+
+    close(ready[0]);
+}
+
+
+
+/********************
+ * Command prefixes *
+ ********************/
+
+/*
+ * Prefixes change the process of the command they are written before,
+ * e.g. 'limit -t 10 cmd' or 'pin -c 2 cmd'. They are applied in the child
+ * between fork and exec, so they affect neither the shell nor the other
+ * stages of a pipeline.
+ */
+static bool is_command_prefix(const std::string& token)
+{
+    return token.compare("limit") == 0 || token.compare("pin") == 0;
+}
+
+
+static bool has_command_prefix(Job& job)
+{
+    for(Command& command : job.getCommands())
+    {
+        if(command.getNumTokens() > 0 && is_command_prefix(command.getTokenArray()[0]))
+            return true;
+    }
+
+    return false;
+}
+
+
+/*
+ * Applies the prefixes a command starts with to the current process, the
+ * given stage of its pipeline, and removes them from the command. A
+ * command without a pin prefix gets the shell's placement. Returns false
+ * (having printed why) if one of them is not valid or leaves no command
+ * to run.
+ */
+static bool apply_command_prefixes(Command& command, int stage)
+{
+    std::vector<std::string> tokens = command.getTokenArray();
+    placement_t placement = default_placement();
+    size_t first = 0;
+    int next;
+
+    while(first < tokens.size() && is_command_prefix(tokens[first]))
+    {
+        if(tokens[first].compare("pin") == 0)
+        {
+            placement = placement_t();
+            next = parse_placement_arguments(tokens, first+1, false, placement);
+        }
+        else
+        {
+            limit_arguments_t arguments;
+            next = parse_limit_arguments(tokens, first+1, true, arguments);
+
+            if(next >= 0 && set_limits(arguments) != 0)
+                return false;
+        }
+
+        if(next < 0)
+            return false;
+
+        first = next;
+    }
+
+    if(first > 0 && first == tokens.size())
+    {
+        print_error("usage: " + tokens[0] + " [options] command [args...]");
+        return false;
+    }
+
+    if(apply_placement(placement, stage) != 0)
+        return false;
+
+    if(first == 0)
+        return true;
+
+    std::vector<std::string> command_tokens(tokens.begin() + first, tokens.end());
+    command.getTokenArray().clear();
+    command.setTokenArray(command_tokens);
+
+    return true;
+}
+
+
+/*
+ * Removes the timeout prefixes from the commands of a foreground job, since
+ * the shell enforces them itself while it waits, and shortens timeout to
+ * the shortest of them. A timeout that is not followed by a duration is
+ * left to the timeout program. Returns false (having printed why) if one
+ * leaves no command to run.
+ */
+static bool take_timeout_prefixes(Job& job, job_timeout_t& timeout)
+{
+    for(Command& command : job.getCommands())
+    {
+        std::vector<std::string> tokens = command.getTokenArray();
+        if(tokens.empty() || tokens[0].compare("timeout") != 0)
+            continue;
+
+        job_timeout_t prefix;
+        int next = parse_timeout_arguments(tokens, 1, prefix);
+
+        if(next < 0)
+            continue;
+
+        if(next == (int) tokens.size())
+        {
+            print_error("usage: timeout [-k duration] duration command [args...]");
+            return false;
+        }
+
+        if(prefix.duration_ms > 0 && (timeout.duration_ms == 0 || prefix.duration_ms < timeout.duration_ms))
+            timeout = prefix;
+
+        std::vector<std::string> command_tokens(tokens.begin() + next, tokens.end());
+        command.getTokenArray().clear();
+        command.setTokenArray(command_tokens);
+    }
+
+    return true;
 }
 
-void initialize_sighandler_table()
+
+
+/*
+ * Checks if a command can be started by the fork server. Its redirections
+ * are made in the shell and the server gets the result, so a command that
+ * needs relay processes (more than one file for a stream) or has process
+ * substitutions is forked as before, as is one with a prefix, which needs
+ * the shell's code to run in the child.
+ */
+static bool can_use_fork_server(Job& job)
 {
-    // insert signals and corresponding signal handlers into the table
-    for(int i = 0; i < num_sighandlers; i++)
+    if(!fork_server_available() || !job.getProcessSubstitutions().empty() || has_command_prefix(job) || \
+        !placement_is_empty(default_placement()) || limits_changed() || \
+        (job.isBackground() && background_policy().enabled))
     {
-        sighandler_table.insert(signum_list[i], signal_handler_list[i]);
+        return false;
     }
 
-    // install each signal handler
-    for(auto it = sighandler_table.begin(); it != sighandler_table.end(); ++it)
-    {
-        Signal(it->first, it->second);
-    }
+    Command& command = job.getCommands()[0];
+    return command.getInputFiles().size() <= 1 && command.getOutputFiles().size() <= 1 && \
+        command.getErrorFiles().size() <= 1;
 }
 
 
 /*
- * Checks if a given command is a builtin command. Used to determine whether
- * to call execute_builtin or execute_external_command.
+ * Starts a single command with the fork server. Returns false if it has to
+ * be forked instead. Otherwise pid is the command's, or -1 if one of its
+ * redirections failed.
  */
-bool is_builtin(Job& job)
+static bool spawn_single_command(Job& job, pid_t& pid)
 {
-    if(job.getNumCommands() == 0)
-        return false;
-    
-    Command first_command = job.getCommands()[0];
-    if(first_command.getNumTokens() == 0)
-        return false;
+    Command& command = job.getCommands()[0];
+    shell_redirection_t saved;
 
-    std::string command_name = job.getCommands()[0].getTokenArray()[0];
+    pid = -1;
+    if(redirect_shell(command, &saved) != 0)
+        return true;
 
-    bool bi_table_contains = builtin_table.contains(command_name);
-    bool single_command = (job.getNumCommands() == 1);
-    
-    return bi_table_contains && single_command;
+    int num_args = command.getNumTokens();
+    char *args[num_args+1];
+    make_args(command, args, num_args);
+
+    pid = spawn_with_fork_server(args);
+    restore_shell_redirection(saved);
+
+    return pid >= 0;
 }
 
 
 /*
- * Executes a given builtin command by accessing builtin table and
- * calling the function stored there.
+ * Called in a child whose execvp failed: reports why and exits with the
+ * status for it, so that $? tells a missing command from a failed one.
  */
-void execute_builtin(Job& job)
+static void exit_exec_failure(const char *command)
 {
-    std::string command_name = job.getCommands()[0].getTokenArray()[0];
-    builtin_t command_function = builtin_table[command_name];
-    
-    int argc = job.getCommands()[0].getNumTokens();
-    std::string *argv = &job.getCommands()[0].getTokenArray()[0];
-
-    command_function(argc, argv);
-}
+    int error = errno;
+    count_stat(STAT_EXEC_FAILURES);
 
+    if(exec_failure_status(error) == 127)
+        print_error("Command not found...");
+    else
+        print_error(std::string(command) + ": " + strerror(error));
 
-void make_args(Command& current_command, char **args, int num_args)
-{
-    for(int j = 0; j < num_args; j++)
-    {
-        char *temp = (char*)current_command.getTokenArray()[j].c_str();
-        args[j] = (char*) malloc(sizeof(char)*strlen(temp)+1);
-        strcpy(args[j], temp);
-    }
-    args[num_args] = NULL;
+    flush_all_output();
+    _exit(exec_failure_status(error));
 }
 
 
 /*
- * Implements the input, output, and error redirection
+ * Executes a single external command. No need for plumbing
  */
-void do_redirection(Job& job, Command& current_command, int command_number)
+void execute_single_command(Job& job, const job_timeout_t& timeout)
 {
-    // redirect input
-    if(current_command.isInputRedirected() && (command_number == 0))
+    pid_t pid;
+    uint64_t spawn_start = stats_clock();
+    uint64_t start = trace_start();
+
+    if(can_use_fork_server(job) && spawn_single_command(job, pid))
     {
-        int redirected_input = open(current_command.getInputFiles()[0].c_str(), O_RDONLY);
-        dup2(redirected_input, STDIN_FILENO);
-        close(redirected_input);
-    }
+        if(pid < 0)
+            return;
 
-    // redirect output
-    if(current_command.isOutputRedirected() && (command_number == job.getNumCommands()-1))
+        // the child is the server's, so only the request is seen from here
+        trace_span("spawn", start, job.getCommands()[0].getTokenArray()[0].c_str());
+        if(trace_enabled)
+            trace_record("exec", 'B', pid, trace_clock(), 0, job.getCommands()[0].getTokenArray()[0].c_str());
+    }
+    else
     {
-        int redirected_output = open(current_command.getOutputFiles()[0].c_str(), O_WRONLY | O_CREAT);
-        dup2(redirected_output, STDOUT_FILENO);
-        close(redirected_output);
+        int ready[2];
+        open_priority_handshake(job, ready);
+
+        pid = fork();
+        if(pid == 0)
+            child_priority_handshake(ready);
+        else
+            parent_priority_handshake(ready);
+
+        if(pid > 0)
+            trace_span("fork", start);
     }
 
-    // redirect error
-    if(current_command.isErrorRedirected())
+    if(pid > 0)
     {
-        int redirected_error = open(current_command.getErrorFiles()[0].c_str(), O_WRONLY | O_CREAT);
-        dup2(redirected_error, STDERR_FILENO);
-        close(redirected_error);
+        count_stat(STAT_FORKS);
+        record_stat(STAT_SPAWN_LATENCY, spawn_start);
     }
-}
-
-
-/*
- * Executes a single external command. No need for plumbing
- */
-void execute_single_command(Job& job)
-{
-    pid_t pid = fork();
 
     if(pid < 0)
-        std::cout << strerror(errno) << std::endl;
+        print_error(strerror(errno));
     
     else if(pid == 0)
     {
+        uint64_t child_start = trace_start();
         Command current_command = job.getCommands()[0];
-        do_redirection(job, current_command, 0);
+        inherit_process_substitutions(job, 0);
+        do_redirection(job, current_command, 0, timeout.duration_ms > 0);
+
+        if(!apply_command_prefixes(current_command, 0))
+        {
+            flush_all_output();
+            _exit(1);
+        }
 
         int num_args = current_command.getNumTokens();
         char *args[num_args+1];
         make_args(current_command,args,num_args);
+        trace_exec(child_start, args[0]);
+        count_stat(STAT_EXECS);
         execvp(args[0], args);
-        
-        std::cout << "Command not found..." << std::endl;
+
+        exit_exec_failure(args[0]);
+    }
+
+    else if(job.isBackground())
+    {
+        job.addPid(pid);
+        add_background_job(job);
+        set_exit_status(0);
     }
 
     else
     {
-        waitpid(pid, NULL, 0);
+        std::string name = job.getCommands()[0].getTokenArray()[0];
+        std::vector<int> statuses;
+
+        prefetch_next_command(job);
+        wait_for_processes(std::vector<pid_t>(1, pid), timeout, name, statuses);
+        set_pipe_status(statuses, 1);
     }
 }
 
@@ -248,7 +1066,7 @@ void connect_pipes(Job& job, int fds[][2], int i)
  * pipes, redirects output, and then waits on the children 1 by 1 if
  * run in the foreground and continues if run in the background.
  */
-void execute_pipeline(Job& job)
+void execute_pipeline(Job& job, const job_timeout_t& timeout)
 {
     // plumbing
     int fds[job.getNumCommands()-1][2];
@@ -264,41 +1082,64 @@ void execute_pipeline(Job& job)
         Command current_command = job.getCommands()[i];
 
         // fork new process
+        uint64_t spawn_start = stats_clock();
+        uint64_t start = trace_start();
+
+        int ready[2];
+        open_priority_handshake(job, ready);
+
         pids[i] = fork();
 
+        if(pids[i] == 0)
+            child_priority_handshake(ready);
+        else
+            parent_priority_handshake(ready);
+
 
         // error in forking
         if(pids[i] < 0)
         {
-            std::cout << strerror(errno) << std::endl;
+            print_error(strerror(errno));
             break;
         }
 
         // child process
         else if(pids[i] == 0)
         {
-            // function implements the redirection
-            do_redirection(job, current_command, i);
-            
+            uint64_t child_start = trace_start();
+
             // connects the pipeline
             connect_pipes(job, fds, i);
+            inherit_process_substitutions(job, i);
 
+            // function implements the redirection, which takes precedence over the pipes
+            do_redirection(job, current_command, i, timeout.duration_ms > 0);
+
+            if(!apply_command_prefixes(current_command, i))
+            {
+                flush_all_output();
+                _exit(1);
+            }
 
             int num_args = current_command.getTokenArray().size();
             char *args[num_args+1];
             make_args(current_command, args, num_args);
-            
+            trace_exec(child_start, args[0]);
+            count_stat(STAT_EXECS);
 
             execvp(args[0], args);
 
-            std::cout << "Command does not exist" << std::endl;
-
-            _exit(1);
+            exit_exec_failure(args[0]);
         }
 
         // parent process
         else
         {
+            trace_span("fork", start);
+            count_stat(STAT_FORKS);
+            record_stat(STAT_SPAWN_LATENCY, spawn_start);
+            job.addPid(pids[i]);
+
             if(i > 0 && i < job.getNumCommands()-1)
             {
                 close(fds[i][1]);
@@ -312,24 +1153,23 @@ void execute_pipeline(Job& job)
             {
                 close(fds[i-1][0]);
             }
-
-            if(i == job.getNumCommands()-1 && job.isBackground())
-            {
-                job_table.insert(next_job_number, job);
-                next_job_number++;
-                break;
-            }
         }
     }
 
     // wait on child processes if job is not run in the background
-    if(!job.isBackground())
+    if(job.isBackground())
     {
-        for(int i = 0; i < job.getNumCommands(); i++)
-        {
-            int status;
-            waitpid(pids[i], &status, 0);
-        }
+        add_background_job(job);
+        set_exit_status(0);
+    }
+    else
+    {
+        std::string name = job.getCommands()[0].getTokenArray()[0];
+        std::vector<int> statuses;
+
+        prefetch_next_command(job);
+        wait_for_processes(job.getPids(), timeout, name, statuses);
+        set_pipe_status(statuses, job.getNumCommands());
     }
 }
 
@@ -341,10 +1181,346 @@ void execute_pipeline(Job& job)
  */
 void execute_external_command(Job& job)
 {
+    job_timeout_t timeout = {0, DEFAULT_KILL_AFTER_MS};
+
+    if(!job.isBackground())
+    {
+        timeout = default_timeout();
+        if(!take_timeout_prefixes(job, timeout))
+            return;
+    }
+
+    // every stage of the job has to see the same CPUs to spread over
+    if(default_placement().spread || has_command_prefix(job))
+        plan_spread();
+
     if(job.getNumCommands() == 1)
-        execute_single_command(job);
+        execute_single_command(job, timeout);
+    else
+        execute_pipeline(job, timeout);            
+}
+
+
+
+/***************
+ * Coprocesses *
+ ***************/
+
+/*
+ * Checks if a job starts with the coproc keyword.
+ */
+static bool is_coprocess(Job& job)
+{
+    if(job.getNumCommands() == 0 || job.getCommands()[0].getNumTokens() == 0)
+        return false;
+
+    return job.getCommands()[0].getTokenArray()[0].compare("coproc") == 0;
+}
+
+
+/*
+ * Reads the descriptor given to -r or -w. Returns -1 if it is not one of
+ * the user's descriptors.
+ */
+static int parse_coprocess_fd(const std::string& text)
+{
+    if(text.size() != 1 || text[0] < '0' || text[0] >= '0' + USER_FD_LIMIT)
+        return -1;
+
+    return text[0] - '0';
+}
+
+
+/*
+ * Returns the lowest free user descriptor from 3 up that is not taken,
+ * or -1 if there is none.
+ */
+static int find_coprocess_fd(int taken)
+{
+    for(int fd = 3; fd < USER_FD_LIMIT; fd++)
+    {
+        if(fd != taken && !is_fd_open(fd))
+            return fd;
+    }
+
+    return -1;
+}
+
+
+/*
+ * Starts 'coproc [-r FD] [-w FD] command...' in the background with its
+ * standard input and output connected to the shell by pipes, so a filter
+ * can serve many requests from a script without being started for each
+ * one. The command may be a pipeline and may have its own redirections.
+ * The shell reads the coprocess's output from FD (by default the lowest
+ * free descriptor from 3 up) and writes to its input on the -w FD (by
+ * default the next free one), so a script uses it with '>&4' and '<&3'.
+ * Closing the descriptor it writes to ('exec 4>&-') ends the coprocess's
+ * input.
+ */
+static void start_coprocess(Job& job)
+{
+    std::vector<std::string>& tokens = job.getCommands()[0].getTokenArray();
+    int read_fd = -1;
+    int write_fd = -1;
+
+    size_t first = 1;
+    while(first+1 < tokens.size() && (tokens[first] == "-r" || tokens[first] == "-w"))
+    {
+        int fd = parse_coprocess_fd(tokens[first+1]);
+        if(fd < 0)
+        {
+            print_error("coproc: " + tokens[first+1] + ": not a descriptor from 0 to 9");
+            return;
+        }
+
+        if(tokens[first] == "-r")
+            read_fd = fd;
+        else
+            write_fd = fd;
+
+        first += 2;
+    }
+
+    if(first == tokens.size())
+    {
+        print_error("usage: coproc [-r FD] [-w FD] command [args...]");
+        return;
+    }
+
+    std::vector<std::string> command_tokens(tokens.begin() + first, tokens.end());
+    tokens.clear();
+    job.getCommands()[0].setTokenArray(command_tokens);
+
+    if(read_fd < 0)
+        read_fd = find_coprocess_fd(write_fd);
+    if(write_fd < 0)
+        write_fd = find_coprocess_fd(read_fd);
+
+    if(read_fd < 0 || write_fd < 0 || read_fd == write_fd)
+    {
+        print_error("coproc: no free descriptors for the coprocess");
+        return;
+    }
+
+    int to_coprocess[2];
+    int from_coprocess[2];
+
+    if(pipe(to_coprocess) != 0)
+    {
+        print_error(strerror(errno));
+        return;
+    }
+
+    if(pipe(from_coprocess) != 0)
+    {
+        print_error(strerror(errno));
+        close(to_coprocess[0]);
+        close(to_coprocess[1]);
+        return;
+    }
+
+    // the shell's ends must not be inherited by the coprocess itself
+    int shell_read = move_to_shell_fd(from_coprocess[0]);
+    int shell_write = move_to_shell_fd(to_coprocess[1]);
+
+    /*
+     * the commands get the pipes as their standard input and output the
+     * same way they get the shell's, so pipelines and redirections work
+     * unchanged
+     */
+    int saved_input = save_fd(STDIN_FILENO);
+    int saved_output = save_fd(STDOUT_FILENO);
+
+    dup2(to_coprocess[0], STDIN_FILENO);
+    dup2(from_coprocess[1], STDOUT_FILENO);
+    close(to_coprocess[0]);
+    close(from_coprocess[1]);
+
+    struct stat info;
+    fstat(shell_write, &info);
+
+    coprocess_fd_t coprocess_fd;
+    coprocess_fd.fd = write_fd;
+    coprocess_fd.pipe = info.st_ino;
+
+    job.setBackground(true);
+    job.addCoprocessFd(coprocess_fd);
+
+    int next_job = next_job_number;
+    execute_external_command(job);
+
+    restore_fd(STDIN_FILENO, saved_input);
+    restore_fd(STDOUT_FILENO, saved_output);
+
+    /*
+     * the script's ends are close-on-exec: commands only get them by
+     * redirecting one to a standard stream, so the coprocess sees the end
+     * of its input as soon as the shell closes it
+     */
+    dup2(shell_read, read_fd);
+    dup2(shell_write, write_fd);
+    fcntl(read_fd, F_SETFD, FD_CLOEXEC);
+    fcntl(write_fd, F_SETFD, FD_CLOEXEC);
+    close(shell_read);
+    close(shell_write);
+
+    if(interactive && job_table.contains(next_job))
+    {
+        print_output("[" + std::to_string(next_job) + "] " + std::to_string(job_table.get(next_job).getPids().back()) +
+            " reading on fd " + std::to_string(read_fd) + ", writing on fd " + std::to_string(write_fd));
+    }
+}
+
+
+
+/*
+ * Executes a parsed job in the current shell process, either by calling
+ * the builtin directly or by forking the external command or pipeline.
+ */
+void execute_job(Job& job)
+{
+    // children would otherwise inherit (and write) anything still buffered
+    flush_all_output();
+
+    reap_background_jobs();
+    expand_exit_status(job);
+
+    // until the job says otherwise, e.g. if a redirection fails
+    set_exit_status(1);
+
+    uint64_t job_start = stats_clock();
+    uint64_t start = trace_start();
+    start_process_substitutions(job);
+
+    if(is_coprocess(job))
+        start_coprocess(job);
+    else if(is_builtin(job))
+        execute_builtin(job);
     else
-        execute_pipeline(job);            
+        execute_external_command(job);
+
+    finish_process_substitutions(job);
+    trace_span("execute", start, job.getCommands()[0].getNumTokens() > 0 ? \
+        job.getCommands()[0].getTokenArray()[0].c_str() : NULL);
+
+    if(!job.isBackground())
+        record_stat(STAT_FOREGROUND_JOB_TIME, job_start);
+
+    // the command is finished, so everything it printed is written now
+    flush_all_output();
+}
+
+
+/*
+ * Executes a command list, running each job only if its condition holds
+ * for the exit status of the job run before it. A job that is skipped
+ * leaves that status as it was, so 'a && b || c' runs c if a or b fails.
+ */
+void execute_list(JobList& list)
+{
+    bool main_loop = (&list == main_loop_list);
+
+    for(int i = 0; i < list.getNumJobs(); i++)
+    {
+        run_condition_t condition = list.getConditions()[i];
+
+        if((condition == RUN_IF_SUCCEEDED && last_status != 0) || (condition == RUN_IF_FAILED && last_status == 0))
+            continue;
+
+        // expanding $? changes the job, and the lists of a script are cached
+        Job job = list.getJobs()[i];
+
+        // a job before the last one could define an alias the next line uses
+        if(main_loop && i == list.getNumJobs()-1)
+            main_loop_job = &job;
+
+        execute_job(job);
+
+        if(main_loop)
+            main_loop_job = NULL;
+    }
+}
+
+
+
+/*********************
+ * Startup profiling *
+ *********************/
+
+/*
+ * Timestamps taken with --startup-profile. The first one is taken by a
+ * constructor that runs before any other static initializer in the shell,
+ * so the first phase covers static initialization (the tables, the C++
+ * runtime, etc.) up to the start of main.
+ */
+static struct timespec static_init_time;
+static struct timespec phase_start_time;
+
+static bool startup_profile = false;
+static bool use_fork_server = false;
+static const char *phase_names[MAX_STARTUP_PHASES];
+static long phase_times[MAX_STARTUP_PHASES];
+static int num_phases = 0;
+
+
+__attribute__((constructor(101))) static void record_static_init_time()
+{
+    clock_gettime(CLOCK_MONOTONIC, &static_init_time);
+}
+
+
+static long microseconds_between(struct timespec& start, struct timespec& stop)
+{
+    return (stop.tv_sec - start.tv_sec)*1000000 + (stop.tv_nsec - start.tv_nsec)/1000;
+}
+
+
+/*
+ * Ends the current startup phase and starts the next one. Does nothing
+ * unless --startup-profile was given.
+ */
+static void end_startup_phase(const char *name)
+{
+    if(!startup_profile || num_phases == MAX_STARTUP_PHASES)
+        return;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    phase_names[num_phases] = name;
+    phase_times[num_phases] = microseconds_between(phase_start_time, now);
+    num_phases++;
+
+    phase_start_time = now;
+}
+
+
+/*
+ * Prints the time spent in each phase to standard error. Written with
+ * snprintf and write so the report itself does not pull in iostream.
+ */
+static void print_startup_profile()
+{
+    if(!startup_profile)
+        return;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    char line[128];
+    int length = snprintf(line, sizeof(line), "josh startup profile (microseconds)\n");
+    write(STDERR_FILENO, line, length);
+
+    for(int i = 0; i < num_phases; i++)
+    {
+        length = snprintf(line, sizeof(line), "  %-24s %8ld\n", phase_names[i], phase_times[i]);
+        write(STDERR_FILENO, line, length);
+    }
+
+    length = snprintf(line, sizeof(line), "  %-24s %8ld\n", "total to first read", \
+        microseconds_between(static_init_time, now));
+    write(STDERR_FILENO, line, length);
 }
 
 
@@ -355,72 +1531,146 @@ void execute_external_command(Job& job)
 
 int main(int argc, char *argv[])
 {
+    clock_gettime(CLOCK_MONOTONIC, &phase_start_time);
+
+    // before anything is forked, so the children's counts are shared
+    start_stats();
 
-    // initialize login name
-    if(get_login_name(login_name, MAX_USERNAME_LENGTH) != 0)
+    for(int i = 1; i < argc; i++)
     {
-        std::cout << "Could not login. Exiting..." << std::endl;
-        return -1;
+        if(strcmp(argv[i], "--startup-profile") == 0)
+            startup_profile = true;
+        else if(strcmp(argv[i], "--fork-server") == 0)
+            use_fork_server = true;
+        else if(strcmp(argv[i], "--batch") == 0)
+            batch = true;
+        else if(strcmp(argv[i], "--batch-report") == 0)
+            batch_report = true;
+        else if(strcmp(argv[i], "--prefetch") == 0)
+            prefetch = true;
     }
 
-
-    if(gethostname(host_name, MAX_HOSTNAME_LENGTH) != 0)
+    if(startup_profile)
     {
-        std::cout << strerror(errno) << std::endl;
-        return -1;
+        phase_names[num_phases] = "static initialization";
+        phase_times[num_phases] = microseconds_between(static_init_time, phase_start_time);
+        num_phases++;
     }
 
-    // initialize the various tables for shell functionality
-    initialize_builtin_table();
+    end_startup_phase("arguments");
+
+    // before the fork server, so the variable is not passed on to commands
+    start_tracing();
+
+    // forked before anything else is allocated, so it stays small
+    if(use_fork_server && start_fork_server() == 0)
+        end_startup_phase("fork server");
+
+    /*
+     * the prompt, history, and completion are only needed when a user is
+     * typing at a terminal, so a shell reading commands from a pipe or file
+     * skips all of that work (including looking up the host name). --batch
+     * does the same on a terminal
+     */
+    interactive = isatty(STDIN_FILENO) && !batch;
+
+    // the builtin table is initialized lazily on the first lookup
     initialize_sighandler_table();
+    end_startup_phase("signal handlers");
+
+    if(interactive)
+    {
+        // look up the user, host, and working directory shown in the prompt
+        if(initialize_prompt() != 0)
+        {
+            print_error(strerror(errno));
+            return -1;
+        }
+        end_startup_phase("prompt");
+
+        set_completion_function(complete_word);
+        start_command_index();
+        end_startup_phase("completion index");
+    }
+
+    print_startup_profile();
     
 
+    clock_gettime(CLOCK_MONOTONIC, &batch_start_time);
+
     while(true)
     {
-        //std::getline(std::cin, command_input, '\n');
-        std::cout << make_prompt();
         std::string command_input;
+        JobList current_list;
+        bool parsed;
 
-        fflush(stdin);
-        fflush(stdout);
-        std::getline(std::cin >> std::ws, command_input);
-        
-        
-        // check alias table before parsing job
-        if(alias_table.contains(command_input))
+        flush_all_output();
+
+        if(prefetched.ready)
         {
-            command_input = alias_table[command_input];
+            command_input = prefetched.line;
+            current_list = prefetched.list;
+            parsed = prefetched.parsed;
+            prefetched.ready = false;
         }
+        else
+        {
+            uint64_t start = trace_start();
 
+            // batch mode reads large blocks and skips the prompt and line editor
+            if(interactive ? !read_line(make_prompt(), command_input) : !read_batch_line(command_input))
+                break;
 
-        // parse command input
-        Job current_job;
-        try
-        {
-            current_job = getJob(command_input);
+            strip_line(command_input);
+            trace_span("read", start);
+
+            if(interactive)
+            {
+                start = trace_start();
+
+                // replace !! and !prefix with the command from the history
+                std::string history_event = command_input;
+                if(!expand_history(command_input))
+                {
+                    print_error(history_event + ": event not found");
+                    continue;
+                }
+
+                // show the command that a history event expanded to, like bash does
+                if(command_input != history_event)
+                    print_output(command_input);
+
+                add_history(command_input);
+                trace_span("history", start);
+            }
+
+            parsed = parse_line(command_input, current_list);
         }
-        catch(const std::runtime_error& e)
+
+        if(!parsed)
         {
-            std::cout << "Parse error. Please enter correct syntax." << std::endl;
+            print_error("Parse error. Please enter correct syntax.");
             continue;
         }
 
         // empty command
-        if(current_job.getNumCommands() == 0)
+        if(current_list.getNumJobs() == 0)
         {
-            fflush(stdin);
-            fflush(stdout);
             continue;
         }
 
 
-        if(is_builtin(current_job))
-            execute_builtin(current_job);
-        else
-            execute_external_command(current_job);
+        batch_commands++;
 
+        main_loop_list = &current_list;
+        execute_list(current_list);
+        main_loop_list = NULL;
     }
 
 
-    return 0;
+    // like other shells, the status of the last command run
+    print_batch_report();
+    finish_shell_redirections();
+    finish_tracing();
+    return last_status;
 }
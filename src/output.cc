@@ -0,0 +1,128 @@
+/*
+ * File: output.cc
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * This file implements the buffered output. Only one file descriptor owns
+ * the buffer at a time, and output to a different one writes the buffer
+ * out first. This keeps the order of everything the shell prints the same
+ * as it would be with unbuffered writes, while a builtin printing many
+ * lines to one place still only makes a system call per buffer.
+ */
+
+
+#include <string>
+
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/uio.h>
+
+
+#include <output.h>
+
+
+static char output_buffer[OUTPUT_BUFFER_SIZE];
+static size_t output_used = 0;
+static int output_fd = -1;
+
+
+
+/*
+ * Writes every vector, retrying after partial writes and signals. Output
+ * that cannot be written (e.g. a closed pipe) is dropped.
+ */
+static void write_vectors(int fd, struct iovec *vectors, int count)
+{
+    while(count > 0)
+    {
+        ssize_t written = writev(fd, vectors, count);
+
+        if(written < 0)
+        {
+            if(errno == EINTR)
+                continue;
+
+            return;
+        }
+
+        while(count > 0 && (size_t) written >= vectors->iov_len)
+        {
+            written -= vectors->iov_len;
+            vectors++;
+            count--;
+        }
+
+        if(count > 0)
+        {
+            vectors->iov_base = (char*) vectors->iov_base + written;
+            vectors->iov_len -= written;
+        }
+    }
+}
+
+
+void write_output(int fd, const char *data, size_t length)
+{
+    if(fd != output_fd)
+    {
+        flush_all_output();
+        output_fd = fd;
+    }
+
+    if(output_used + length <= OUTPUT_BUFFER_SIZE)
+    {
+        memcpy(output_buffer + output_used, data, length);
+        output_used += length;
+        return;
+    }
+
+    struct iovec vectors[2];
+    vectors[0].iov_base = output_buffer;
+    vectors[0].iov_len = output_used;
+    vectors[1].iov_base = (void*) data;
+    vectors[1].iov_len = length;
+
+    write_vectors(fd, vectors, 2);
+    output_used = 0;
+}
+
+
+void write_output(int fd, const std::string& text)
+{
+    write_output(fd, text.data(), text.size());
+}
+
+
+void print_output(const std::string& line)
+{
+    write_output(STDOUT_FILENO, line);
+    write_output(STDOUT_FILENO, "\n", 1);
+}
+
+
+void print_error(const std::string& line)
+{
+    write_output(STDERR_FILENO, line);
+    write_output(STDERR_FILENO, "\n", 1);
+}
+
+
+void flush_output(int fd)
+{
+    if(fd == output_fd)
+        flush_all_output();
+}
+
+
+void flush_all_output()
+{
+    if(output_used == 0)
+        return;
+
+    struct iovec vector;
+    vector.iov_base = output_buffer;
+    vector.iov_len = output_used;
+
+    write_vectors(output_fd, &vector, 1);
+    output_used = 0;
+}
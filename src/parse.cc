@@ -9,10 +9,12 @@
 
 
 
+#include <algorithm>
+#include <stdexcept>
+#include <ctype.h>
 #include <string.h>
 #include <string>
 #include <vector>
-#include <iostream>
 
 #include <job.h>
 #include <parse.h>
@@ -87,6 +89,56 @@ std::vector<std::string> tokenize(char *inputString, char *delimiters)
 
 
 
+/*
+ * Recognizes the redirections of numbered file descriptors: 'N>', 'N>>',
+ * and 'N<' followed by a file name, and the single tokens 'N>&M', 'N<&M',
+ * and 'N>&-'. N is a single digit and defaults to 1 for '>' and 0 for '<'.
+ * Returns the number of tokens used, or 0 if the token is not one of these.
+ */
+static int parse_fd_redirection(std::vector<std::string>& tokens, int i, fd_redirection_t& redirection)
+{
+    std::string token = tokens.at(i);
+    size_t op = (token.size() > 1 && isdigit(token[0])) ? 1 : 0;
+    std::string rest = token.substr(op);
+
+    if(rest.empty() || (rest[0] != '>' && rest[0] != '<'))
+        return 0;
+
+    redirection.fd = (op == 1) ? token[0] - '0' : (rest[0] == '>' ? 1 : 0);
+    redirection.source_fd = -1;
+
+    if(rest.compare(">") == 0 || rest.compare(">>") == 0 || rest.compare("<") == 0)
+    {
+        if(i+1 >= (int) tokens.size())
+            throw std::runtime_error("Bad command: incorrect syntax.");
+
+        redirection.action = (rest.compare(">") == 0) ? FD_OPEN_WRITE : \
+            (rest.compare(">>") == 0) ? FD_OPEN_APPEND : FD_OPEN_READ;
+        redirection.path = tokens.at(i+1);
+        return 2;
+    }
+
+    if(rest.size() == 3 && rest[1] == '&')
+    {
+        if(rest[2] == '-')
+        {
+            redirection.action = FD_CLOSE;
+            return 1;
+        }
+
+        if(isdigit(rest[2]))
+        {
+            redirection.action = FD_DUPLICATE;
+            redirection.source_fd = rest[2] - '0';
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+
 /*
  * Parses an individual command as opposed to an entire pipeline, as above.
  * This function is recursively called by the parse_job function. This is
@@ -192,6 +244,28 @@ Command parse_command(std::vector<std::string> tokens)
             
             
 
+            if(lastFlagIndex < 0)
+            {
+                lastFlagIndex = i - 1;
+            }
+
+            i += 2;
+        }
+
+        // appending output redirection denoted by >>, or by 1>>
+        else if(currentToken.compare(">>") == 0 || currentToken.compare("1>>") == 0)
+        {
+            if(i+1 < tokens.size())
+            {
+                command.addOutputFile(tokens.at(i+1));
+                command.setOutputAppended(true);
+            }
+            else
+            {
+                throw std::runtime_error("Bad command: incorrect syntax.");
+            }
+
+
             if(lastFlagIndex < 0)
             {
                 lastFlagIndex = i - 1;
@@ -202,7 +276,24 @@ Command parse_command(std::vector<std::string> tokens)
 
         else
         {
-            i++;
+            // any other file descriptor (i.e. 3> file, 2>&1, 3>&-)
+            fd_redirection_t redirection;
+            int used = parse_fd_redirection(tokens, i, redirection);
+
+            if(used == 0)
+            {
+                i++;
+                continue;
+            }
+
+            command.addFdRedirection(redirection);
+
+            if(lastFlagIndex < 0)
+            {
+                lastFlagIndex = i - 1;
+            }
+
+            i += used;
         }
     }
 
@@ -230,6 +321,57 @@ Command parse_command(std::vector<std::string> tokens)
 
 
 
+bool is_process_substitution(const std::string& token)
+{
+    return token.size() >= 3 && (token[0] == '<' || token[0] == '>') && token[1] == '(' && token.back() == ')';
+}
+
+
+std::string get_substituted_command(const std::string& token)
+{
+    return token.substr(2, token.size()-3);
+}
+
+
+/*
+ * The tokenizer splits '<(sort a.txt)' into '<(sort' and 'a.txt)'. This
+ * joins the tokens of each process substitution back into one, so that
+ * a pipe inside it is not taken for one of the job's own.
+ */
+static std::vector<std::string> join_process_substitutions(const std::vector<std::string>& tokens)
+{
+    std::vector<std::string> joined;
+    std::string current;
+    int depth = 0;
+
+    for(const std::string& token : tokens)
+    {
+        bool starts = (token.size() >= 2 && (token[0] == '<' || token[0] == '>') && token[1] == '(');
+
+        if(depth == 0 && !starts)
+        {
+            joined.push_back(token);
+            continue;
+        }
+
+        current += (depth == 0) ? token : " " + token;
+        depth += std::count(token.begin(), token.end(), '(') - std::count(token.begin(), token.end(), ')');
+
+        if(depth <= 0)
+        {
+            joined.push_back(current);
+            current.clear();
+            depth = 0;
+        }
+    }
+
+    if(depth > 0)
+        throw std::runtime_error("Bad command: unterminated process substitution.");
+
+    return joined;
+}
+
+
 /*
  * This function takes the token sequence created by the previous function
  * and parses it to create the Job object that stores the information for 
@@ -247,6 +389,8 @@ Job parse_job(std::vector<std::string> tokens)
     {
         return job;
     }
+
+    tokens = join_process_substitutions(tokens);
     
 
     /* 
@@ -333,6 +477,60 @@ Job parse_job(std::vector<std::string> tokens)
 
 
 
+/*
+ * Splits the tokens of a command line into the jobs of a command list at
+ * ';', '&', '&&', and '||', and parses each one with parse_job. The list
+ * may end with ';' or '&', but no job may be empty otherwise. Process
+ * substitutions are joined first, so a list inside one is left to it.
+ */
+JobList parse_list(std::vector<std::string> tokens)
+{
+    JobList list;
+
+    if(tokens.size() == 0)
+        return list;
+
+    tokens = join_process_substitutions(tokens);
+
+    run_condition_t condition = RUN_ALWAYS;
+    size_t start = 0;
+
+    for(size_t stop = 0; stop <= tokens.size(); stop++)
+    {
+        bool end = (stop == tokens.size());
+        if(!end && tokens[stop].compare(";") != 0 && tokens[stop].compare("&") != 0 && \
+            tokens[stop].compare("&&") != 0 && tokens[stop].compare("||") != 0)
+        {
+            continue;
+        }
+
+        // a job started in the background keeps its '&' for parse_job
+        size_t job_end = (!end && tokens[stop].compare("&") == 0) ? stop+1 : stop;
+
+        if(stop == start)
+        {
+            if(end && list.getNumJobs() > 0 && condition == RUN_ALWAYS)
+                break;
+
+            throw std::runtime_error("Bad command: incorrect syntax.");
+        }
+
+        std::vector<std::string> jobTokens(tokens.begin() + start, tokens.begin() + job_end);
+        list.addJob(parse_job(jobTokens), condition);
+
+        if(!end)
+        {
+            condition = (tokens[stop].compare("&&") == 0) ? RUN_IF_SUCCEEDED : \
+                (tokens[stop].compare("||") == 0) ? RUN_IF_FAILED : RUN_ALWAYS;
+        }
+
+        start = stop+1;
+    }
+
+    return list;
+}
+
+
 /*
  * This function is the wrapper function for the lexical analysis
  * and parsing of the command. This is made so that the calling code
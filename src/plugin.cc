@@ -0,0 +1,137 @@
+/*
+ * File: plugin.cc
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * This file implements loading and unloading of builtins from shared
+ * objects using dlopen. Loaded builtins are inserted directly into the
+ * builtin table so they are dispatched the same way as compiled-in ones.
+ */
+
+
+#include <string>
+
+#include <dlfcn.h>
+
+
+#include <builtin.h>
+#include <hashtable.h>
+#include <main.h>
+#include <output.h>
+#include <plugin.h>
+
+
+/*
+ * Bookkeeping for a single loaded builtin. Every load does its own dlopen
+ * so the dynamic loader's reference count keeps the shared object mapped
+ * until the last builtin loaded from it is removed.
+ */
+typedef struct
+{
+    void *handle;
+    std::string path;
+    builtin_t shadowed;
+} loaded_plugin_t;
+
+
+static Table<std::string, loaded_plugin_t> plugin_table;
+
+
+
+int load_builtin_plugin(std::string path, std::string name)
+{
+    if(plugin_table.contains(name))
+    {
+        print_error("enable: " + name + ": already loaded from " + plugin_table[name].path);
+        return -1;
+    }
+
+    void *handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if(handle == NULL)
+    {
+        print_error(std::string("enable: ") + dlerror());
+        return -1;
+    }
+
+    std::string symbol = name + BUILTIN_PLUGIN_SYMBOL_SUFFIX;
+    builtin_plugin_t *plugin = (builtin_plugin_t*) dlsym(handle, symbol.c_str());
+    if(plugin == NULL)
+    {
+        print_error("enable: " + path + ": no symbol " + symbol);
+        dlclose(handle);
+        return -1;
+    }
+
+    // reject plugins built against a different ABI before touching any other field
+    if(plugin->abi_version != BUILTIN_PLUGIN_ABI_VERSION || plugin->struct_size != sizeof(builtin_plugin_t))
+    {
+        print_error("enable: " + path + ": plugin ABI version " + std::to_string(plugin->abi_version) \
+            + " does not match shell ABI version " + std::to_string(BUILTIN_PLUGIN_ABI_VERSION));
+        dlclose(handle);
+        return -1;
+    }
+
+    if(plugin->function == NULL)
+    {
+        print_error("enable: " + path + ": " + name + " has no function");
+        dlclose(handle);
+        return -1;
+    }
+
+    loaded_plugin_t loaded;
+    loaded.handle = handle;
+    loaded.path = path;
+    loaded.shadowed = NULL;
+
+    // a plugin may replace a compiled-in builtin, which is restored on unload
+    if(builtin_table.contains(name))
+        loaded.shadowed = builtin_table.extract(name);
+
+    builtin_table.insert(name, plugin->function);
+    plugin_table.insert(name, loaded);
+
+    return 0;
+}
+
+
+int unload_builtin_plugin(std::string name)
+{
+    if(!plugin_table.contains(name))
+    {
+        print_error("enable: " + name + ": not a dynamically loaded builtin");
+        return -1;
+    }
+
+    loaded_plugin_t loaded = plugin_table.extract(name);
+    builtin_table.remove(name);
+
+    if(loaded.shadowed != NULL)
+        builtin_table.insert(name, loaded.shadowed);
+
+    if(dlclose(loaded.handle) != 0)
+    {
+        print_error(std::string("enable: ") + dlerror());
+        return -1;
+    }
+
+    return 0;
+}
+
+
+bool is_plugin_builtin(std::string name)
+{
+    return plugin_table.contains(name);
+}
+
+
+void print_builtins()
+{
+    for(auto it = builtin_table.begin(); it != builtin_table.end(); ++it)
+    {
+        std::string line = "enable " + it->first;
+
+        if(plugin_table.contains(it->first))
+            line += "\t(" + plugin_table[it->first].path + ")";
+
+        print_output(line);
+    }
+}
@@ -0,0 +1,185 @@
+/*
+ * File: priority.cc
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * This file implements the background job priority policy with
+ * setpriority and, on Linux, the ioprio_get and ioprio_set system calls
+ * (which have no wrappers in the C library).
+ */
+
+
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+
+#include <output.h>
+#include <priority.h>
+
+
+#define MAX_NICENESS 19
+
+// from linux/ioprio.h
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_BE 2
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_WHO_PROCESS 1
+
+
+static background_policy_t policy = {true, 10, IO_CLASS_BEST_EFFORT, 7};
+
+
+
+background_policy_t& background_policy()
+{
+    return policy;
+}
+
+
+static bool parse_number(const std::string& text, int low, int high, int& number)
+{
+    if(text.empty() || text.size() > 2 || text.find_first_not_of("0123456789") != std::string::npos)
+        return false;
+
+    number = atoi(text.c_str());
+    return number >= low && number <= high;
+}
+
+
+int parse_background_policy(const std::vector<std::string>& args, background_policy_t& new_policy)
+{
+    for(size_t i = 1; i < args.size(); i++)
+    {
+        const std::string& option = args[i];
+
+        if(option.compare("-o") == 0)
+        {
+            new_policy.enabled = false;
+            continue;
+        }
+
+        if(i+1 == args.size())
+        {
+            print_error("bgpriority: " + option + ": needs a value");
+            return -1;
+        }
+
+        const std::string& value = args[++i];
+        new_policy.enabled = true;
+
+        if(option.compare("-n") == 0)
+        {
+            if(!parse_number(value, 0, MAX_NICENESS, new_policy.nice))
+            {
+                print_error("bgpriority: -n: " + value + ": not from 0 to 19");
+                return -1;
+            }
+        }
+        else if(option.compare("-l") == 0)
+        {
+            if(!parse_number(value, 0, 7, new_policy.io_level))
+            {
+                print_error("bgpriority: -l: " + value + ": not from 0 to 7");
+                return -1;
+            }
+        }
+        else if(option.compare("-c") == 0)
+        {
+            if(value.compare("none") == 0)
+                new_policy.io_class = IO_CLASS_NONE;
+            else if(value.compare("best-effort") == 0)
+                new_policy.io_class = IO_CLASS_BEST_EFFORT;
+            else if(value.compare("idle") == 0)
+                new_policy.io_class = IO_CLASS_IDLE;
+            else
+            {
+                print_error("bgpriority: -c: " + value + ": not none, best-effort, or idle");
+                return -1;
+            }
+        }
+        else
+        {
+            print_error("bgpriority: " + option + ": not an option of bgpriority");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+void print_background_policy(const background_policy_t& shown)
+{
+    if(!shown.enabled)
+    {
+        print_output("bgpriority -o");
+        return;
+    }
+
+    std::string line = "bgpriority -n " + std::to_string(shown.nice) + " -c ";
+
+    if(shown.io_class == IO_CLASS_NONE)
+        line += "none";
+    else if(shown.io_class == IO_CLASS_IDLE)
+        line += "idle";
+    else
+        line += "best-effort -l " + std::to_string(shown.io_level);
+
+    print_output(line);
+}
+
+
+void apply_background_policy()
+{
+    if(!policy.enabled)
+        return;
+
+    // nice stops at the highest niceness by itself
+    if(policy.nice > 0)
+        nice(policy.nice);
+
+#if defined(__linux__)
+    if(policy.io_class == IO_CLASS_BEST_EFFORT)
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, (IOPRIO_CLASS_BE << IOPRIO_CLASS_SHIFT) | policy.io_level);
+    else if(policy.io_class == IO_CLASS_IDLE)
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+#endif
+}
+
+
+int restore_priority(pid_t pid, bool report)
+{
+    int result = 0;
+
+    errno = 0;
+    int niceness = getpriority(PRIO_PROCESS, 0);
+
+    if(errno == 0 && setpriority(PRIO_PROCESS, pid, niceness) != 0 && errno != ESRCH)
+    {
+        if(report)
+            print_error(std::string("fg: could not restore the priority: ") + strerror(errno));
+        result = -1;
+    }
+
+#if defined(__linux__)
+    int io_priority = syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, 0);
+
+    if(io_priority >= 0 && syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, pid, io_priority) != 0 && errno != ESRCH)
+    {
+        if(report)
+            print_error(std::string("fg: could not restore the I/O priority: ") + strerror(errno));
+        result = -1;
+    }
+#endif
+
+    return result;
+}
@@ -0,0 +1,478 @@
+/*
+ * File: prompt.cc
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * This file implements prompt rendering. Everything the prompt shows is
+ * looked up once and cached: the user and host at startup, and the working
+ * directory whenever cd changes it. The template is compiled into segments
+ * when PS1 changes, and the rendered prompt itself is reused until one of
+ * its inputs changes.
+ *
+ * The version control segment needs to run git, which can take a long time
+ * in a big repository. It is computed by a worker thread, and the prompt
+ * always uses the last result for the current directory, so a slow or
+ * hung git never delays the prompt.
+ */
+
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pwd.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+
+#include <descriptors.h>
+#include <prompt.h>
+
+
+#define MAX_HOSTNAME_LENGTH 256
+
+
+extern char **environ;
+
+
+typedef enum
+{
+    SEGMENT_LITERAL,
+    SEGMENT_USER,
+    SEGMENT_HOST,
+    SEGMENT_FULL_HOST,
+    SEGMENT_DIRECTORY,
+    SEGMENT_DIRECTORY_NAME,
+    SEGMENT_PROMPT_CHAR,
+    SEGMENT_VCS
+} segment_type_t;
+
+
+typedef struct
+{
+    segment_type_t type;
+    std::string text;
+} prompt_segment_t;
+
+
+// values used by the prompt
+static bool prompt_initialized = false;
+static std::string login_name;
+static std::string host_name;
+static std::string short_host_name;
+static std::string current_directory;
+static std::string display_directory;
+static std::string directory_name;
+
+// compiled template and the last prompt rendered from it
+static std::string prompt_template;
+static std::vector<prompt_segment_t> prompt_segments;
+static bool prompt_uses_vcs = false;
+static std::string rendered_prompt;
+static bool prompt_dirty = true;
+
+// version control status shared with the worker thread
+static std::mutex vcs_mutex;
+static std::condition_variable vcs_condition;
+static bool vcs_worker_started = false;
+static bool vcs_request_pending = false;
+static std::string vcs_request_directory;
+static std::string vcs_result_directory;
+static std::string vcs_result;
+static std::atomic<bool> vcs_result_changed(false);
+
+
+
+/*
+ * Returns the login name of the user. USER is checked first since it is
+ * set on both Mac OSX and Linux, then the password database.
+ */
+static std::string get_login_name()
+{
+    const char *user = getenv("USER");
+    if(user != NULL)
+        return user;
+
+    struct passwd *pw = getpwuid(getuid());
+    if(pw != NULL)
+        return pw->pw_name;
+
+    return "";
+}
+
+
+int initialize_prompt()
+{
+    login_name = get_login_name();
+
+    char buf[MAX_HOSTNAME_LENGTH];
+    if(gethostname(buf, MAX_HOSTNAME_LENGTH) != 0)
+        return -1;
+
+    buf[MAX_HOSTNAME_LENGTH-1] = '\0';
+    host_name = buf;
+    short_host_name = host_name.substr(0, host_name.find('.'));
+
+    prompt_initialized = true;
+    update_prompt_directory();
+    return 0;
+}
+
+
+/*
+ * getcwd with a NULL buffer allocates one of the right size, so paths of
+ * any length work.
+ */
+void update_prompt_directory()
+{
+    // nothing to keep up to date if there is no prompt
+    if(!prompt_initialized)
+        return;
+
+    char *path = getcwd(NULL, 0);
+    if(path == NULL)
+        return;
+
+    current_directory = path;
+    free(path);
+
+    const char *home = getenv("HOME");
+    size_t home_length = (home != NULL) ? strlen(home) : 0;
+
+    if(home_length > 1 && current_directory.compare(0, home_length, home) == 0 \
+        && (current_directory.size() == home_length || current_directory[home_length] == '/'))
+    {
+        display_directory = "~" + current_directory.substr(home_length);
+    }
+    else
+    {
+        display_directory = current_directory;
+    }
+
+    size_t slash = current_directory.rfind('/');
+    if(current_directory.size() <= 1 || slash == std::string::npos)
+        directory_name = current_directory;
+    else
+        directory_name = current_directory.substr(slash+1);
+
+    prompt_dirty = true;
+}
+
+
+const std::string& get_prompt_directory()
+{
+    return current_directory;
+}
+
+
+
+/****************************
+ * Version control segment *
+ ****************************/
+
+/*
+ * Makes the pipe git writes its status to. It is made on the prompt's
+ * thread while the shell may be forking commands or redirecting 0-9, so
+ * both ends are close-on-exec from the start and moved out of the user's
+ * range.
+ */
+static int make_vcs_pipe(int fds[2])
+{
+#if defined(__linux__)
+    if(pipe2(fds, O_CLOEXEC) != 0)
+        return -1;
+#else
+    if(pipe(fds) != 0)
+        return -1;
+
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+#endif
+
+    fds[0] = move_to_shell_fd(fds[0]);
+    fds[1] = move_to_shell_fd(fds[1]);
+    return 0;
+}
+
+
+/*
+ * Runs 'git status' for the directory and turns the first line of its
+ * output into "(branch)", with a '*' if there are any changes. Gives up
+ * and kills git if it has not finished by the deadline. Returns false if
+ * the status could not be found in time.
+ */
+static bool get_vcs_status(const std::string& directory, std::string& status)
+{
+    int fds[2];
+    if(make_vcs_pipe(fds) != 0)
+        return false;
+
+    // the other ends are close-on-exec, and dup2 clears it for stdout
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+
+    const char *args[] = {"git", "-C", directory.c_str(), "status", "--porcelain", "-b", NULL};
+
+    pid_t pid;
+    int retval = posix_spawnp(&pid, "git", &actions, NULL, (char* const*) args, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+
+    if(retval != 0)
+    {
+        close(fds[0]);
+        return false;
+    }
+
+    std::string output;
+    bool finished = false;
+    char buf[4096];
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while(true)
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long elapsed_ms = (now.tv_sec - start.tv_sec)*1000 + (now.tv_nsec - start.tv_nsec)/1000000;
+
+        if(elapsed_ms >= PROMPT_VCS_DEADLINE_MS)
+            break;
+
+        struct pollfd pfd;
+        pfd.fd = fds[0];
+        pfd.events = POLLIN;
+
+        if(poll(&pfd, 1, PROMPT_VCS_DEADLINE_MS - elapsed_ms) <= 0)
+            continue;
+
+        ssize_t n = read(fds[0], buf, sizeof(buf));
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+        {
+            finished = true;
+            break;
+        }
+
+        output.append(buf, n);
+    }
+
+    close(fds[0]);
+
+    if(!finished)
+        kill(pid, SIGKILL);
+
+    int exit_status;
+    waitpid(pid, &exit_status, 0);
+
+    if(!finished)
+        return false;
+
+    // not a repository (or no git): no segment at all
+    if(!WIFEXITED(exit_status) || WEXITSTATUS(exit_status) != 0 || output.compare(0, 3, "## ") != 0)
+    {
+        status = "";
+        return true;
+    }
+
+    size_t end_of_line = output.find('\n');
+    std::string branch = output.substr(3, end_of_line - 3);
+
+    if(branch.compare(0, 15, "No commits yet ") == 0)
+        branch = branch.substr(branch.rfind(' ') + 1);
+
+    size_t dots = branch.find("...");
+    if(dots != std::string::npos)
+        branch = branch.substr(0, dots);
+
+    bool dirty = (end_of_line != std::string::npos && end_of_line + 1 < output.size());
+
+    status = "(" + branch + (dirty ? "*" : "") + ")";
+    return true;
+}
+
+
+static void vcs_worker()
+{
+    while(true)
+    {
+        std::string directory;
+
+        {
+            std::unique_lock<std::mutex> lock(vcs_mutex);
+            vcs_condition.wait(lock, []{ return vcs_request_pending; });
+
+            directory = vcs_request_directory;
+            vcs_request_pending = false;
+        }
+
+        std::string status;
+        if(!get_vcs_status(directory, status))
+            continue;
+
+        std::lock_guard<std::mutex> lock(vcs_mutex);
+        if(directory != vcs_result_directory || status != vcs_result)
+        {
+            vcs_result_directory = directory;
+            vcs_result = status;
+            vcs_result_changed = true;
+        }
+    }
+}
+
+
+/*
+ * Asks the worker to compute the status for the directory. Requests are
+ * coalesced, so only the most recent directory is ever worked on.
+ */
+static void request_vcs_status(const std::string& directory)
+{
+    std::lock_guard<std::mutex> lock(vcs_mutex);
+
+    if(!vcs_worker_started)
+    {
+        std::thread worker(vcs_worker);
+        worker.detach();
+        vcs_worker_started = true;
+    }
+
+    vcs_request_directory = directory;
+    vcs_request_pending = true;
+    vcs_condition.notify_one();
+}
+
+
+// last known status for the directory, or nothing if there is none yet
+static std::string get_vcs_segment(const std::string& directory)
+{
+    std::lock_guard<std::mutex> lock(vcs_mutex);
+
+    if(vcs_result_directory == directory)
+        return vcs_result;
+
+    return "";
+}
+
+
+
+/*********************
+ * Template rendering *
+ *********************/
+
+static void compile_prompt(const std::string& source)
+{
+    prompt_template = source;
+    prompt_segments.clear();
+    prompt_uses_vcs = false;
+
+    std::string literal;
+
+    for(size_t i = 0; i < source.size(); i++)
+    {
+        if(source[i] != '\\' || i+1 == source.size())
+        {
+            literal += source[i];
+            continue;
+        }
+
+        prompt_segment_t segment;
+        segment.type = SEGMENT_LITERAL;
+
+        switch(source[++i])
+        {
+        case 'u': segment.type = SEGMENT_USER; break;
+        case 'h': segment.type = SEGMENT_HOST; break;
+        case 'H': segment.type = SEGMENT_FULL_HOST; break;
+        case 'w': segment.type = SEGMENT_DIRECTORY; break;
+        case 'W': segment.type = SEGMENT_DIRECTORY_NAME; break;
+        case '$': segment.type = SEGMENT_PROMPT_CHAR; break;
+        case 'g': segment.type = SEGMENT_VCS; break;
+        case 'n': literal += '\n'; continue;
+        case '\\': literal += '\\'; continue;
+        default: literal += '\\'; literal += source[i]; continue;
+        }
+
+        if(!literal.empty())
+        {
+            prompt_segment_t literal_segment;
+            literal_segment.type = SEGMENT_LITERAL;
+            literal_segment.text = literal;
+            prompt_segments.push_back(literal_segment);
+            literal.clear();
+        }
+
+        if(segment.type == SEGMENT_VCS)
+            prompt_uses_vcs = true;
+
+        prompt_segments.push_back(segment);
+    }
+
+    if(!literal.empty())
+    {
+        prompt_segment_t literal_segment;
+        literal_segment.type = SEGMENT_LITERAL;
+        literal_segment.text = literal;
+        prompt_segments.push_back(literal_segment);
+    }
+
+    prompt_dirty = true;
+}
+
+
+std::string make_prompt()
+{
+    const char *ps1 = getenv("PS1");
+    std::string source = (ps1 != NULL) ? ps1 : DEFAULT_PROMPT_TEMPLATE;
+
+    if(source != prompt_template || prompt_segments.empty())
+        compile_prompt(source);
+
+    /*
+     * the status may have changed because of the last command, so ask for
+     * it again, but render with whatever is known right now
+     */
+    if(prompt_uses_vcs)
+        request_vcs_status(current_directory);
+
+    if(vcs_result_changed.exchange(false))
+        prompt_dirty = true;
+
+    if(!prompt_dirty)
+        return rendered_prompt;
+
+    std::string vcs_segment = prompt_uses_vcs ? get_vcs_segment(current_directory) : "";
+
+    rendered_prompt.clear();
+
+    for(const prompt_segment_t& segment : prompt_segments)
+    {
+        switch(segment.type)
+        {
+        case SEGMENT_LITERAL: rendered_prompt += segment.text; break;
+        case SEGMENT_USER: rendered_prompt += login_name; break;
+        case SEGMENT_HOST: rendered_prompt += short_host_name; break;
+        case SEGMENT_FULL_HOST: rendered_prompt += host_name; break;
+        case SEGMENT_DIRECTORY: rendered_prompt += display_directory; break;
+        case SEGMENT_DIRECTORY_NAME: rendered_prompt += directory_name; break;
+        case SEGMENT_PROMPT_CHAR: rendered_prompt += (geteuid() == 0) ? '#' : '$'; break;
+        case SEGMENT_VCS: rendered_prompt += vcs_segment; break;
+        }
+    }
+
+    prompt_dirty = false;
+    return rendered_prompt;
+}
@@ -0,0 +1,696 @@
+/*
+ * File: redirect.cc
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * This file implements redirection. A stream with a single file is simply
+ * pointed at the file. A stream with several files is pointed at a pipe,
+ * and a helper process on the other end either copies the pipe to every
+ * output file or feeds the input files into it one after the other.
+ *
+ * On Linux the output relay does not read the data at all. tee duplicates
+ * what is waiting in the pipe into a scratch pipe, which is spliced to one
+ * file, and this is repeated for every file but the last, which the data
+ * is finally spliced to straight out of the command's pipe. Both pipes
+ * have the same capacity, so a tee of everything that was in the first
+ * pipe always fits in the (empty) scratch pipe.
+ */
+
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+
+#include <descriptors.h>
+#include <output.h>
+#include <redirect.h>
+
+
+// buffer used when data has to be copied through user space
+#define RELAY_BUFFER_SIZE 65536
+
+
+// helpers of the streams that exec redirected, until they are replaced
+static std::vector<relay_helper_t> exec_helpers;
+
+
+
+// prints the error for a redirection of the given file
+static void redirection_error(const std::string& path)
+{
+    print_error(path + ": " + strerror(errno));
+}
+
+
+/*
+ * Opens every file of a redirection. The descriptors are close-on-exec
+ * since the command only ever gets them through dup2. Returns false if a
+ * file could not be opened.
+ */
+static bool open_redirect_files(std::vector<std::string>& paths, int flags, std::vector<int>& fds)
+{
+    for(std::string& path : paths)
+    {
+        int fd = open(path.c_str(), flags | O_CLOEXEC, REDIRECT_FILE_MODE);
+        if(fd < 0)
+        {
+            redirection_error(path);
+
+            for(int opened : fds)
+                close(opened);
+
+            return false;
+        }
+
+        fds.push_back(fd);
+    }
+
+    return true;
+}
+
+
+/*
+ * Called before a descriptor is changed. When redirecting the shell
+ * itself, saves the descriptor the first time it is changed.
+ */
+static void prepare_fd(int fd, std::vector<std::pair<int, int>> *saved)
+{
+    if(saved == NULL)
+        return;
+
+    for(std::pair<int, int>& saved_fd : *saved)
+    {
+        if(saved_fd.first == fd)
+            return;
+    }
+
+    saved->push_back(std::make_pair(fd, save_fd(fd)));
+}
+
+
+static bool write_all(int fd, const char *data, size_t length)
+{
+    while(length > 0)
+    {
+        ssize_t n = write(fd, data, length);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return false;
+
+        data += n;
+        length -= n;
+    }
+
+    return true;
+}
+
+
+/*
+ * Copies up to length bytes from one file descriptor to another, stopping
+ * early at the end of the input or if writing fails. Uses splice when one
+ * side is a pipe and the kernel supports the other side, and otherwise
+ * copies through a buffer. Returns the number of bytes copied.
+ */
+static size_t copy_data(int in, int out, size_t length)
+{
+    size_t copied = 0;
+    bool use_splice = true;
+    char buf[RELAY_BUFFER_SIZE];
+
+    while(copied < length)
+    {
+        size_t chunk = std::min(length - copied, (size_t) RELAY_PIPE_SIZE);
+        ssize_t n;
+
+#if defined(__linux__)
+        if(use_splice)
+        {
+            n = splice(in, NULL, out, NULL, chunk, SPLICE_F_MOVE);
+
+            // e.g. a terminal or a file opened for appending
+            if(n < 0 && errno == EINVAL)
+            {
+                use_splice = false;
+                continue;
+            }
+        }
+        else
+#endif
+        {
+            n = read(in, buf, std::min(chunk, sizeof(buf)));
+            if(n > 0 && !write_all(out, buf, n))
+                return copied;
+        }
+
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            break;
+
+        copied += n;
+    }
+
+    return copied;
+}
+
+
+// throws away data that could not be written anywhere
+static void discard_data(int in, size_t length)
+{
+    char buf[RELAY_BUFFER_SIZE];
+
+    while(length > 0)
+    {
+        ssize_t n = read(in, buf, std::min(length, sizeof(buf)));
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return;
+
+        length -= n;
+    }
+}
+
+
+#if defined(__linux__)
+/*
+ * The zero-copy relay. Returns false if it cannot be used, before any data
+ * has been taken out of the pipe. Files that fail are dropped, and the
+ * relay stops once none are left, like tee does.
+ */
+static bool tee_relay(int in, std::vector<int>& targets)
+{
+    int scratch[2];
+    if(pipe(scratch) != 0)
+        return false;
+
+    int size = fcntl(in, F_GETPIPE_SZ);
+    fcntl(scratch[1], F_SETPIPE_SZ, size);
+
+    if(size < 0 || fcntl(scratch[1], F_GETPIPE_SZ) < size)
+    {
+        close(scratch[0]);
+        close(scratch[1]);
+        return false;
+    }
+
+    while(targets.size() > 1)
+    {
+        // everything waiting in the pipe is duplicated for the first file
+        ssize_t length = tee(in, scratch[1], INT_MAX, 0);
+        if(length < 0 && errno == EINTR)
+            continue;
+        if(length <= 0)
+            return true;
+
+        for(size_t i = 0; i + 1 < targets.size();)
+        {
+            ssize_t duplicated = length;
+
+            // and then again for each of the others
+            while(i > 0 && (duplicated = tee(in, scratch[1], length, 0)) < 0 && errno == EINTR)
+                ;
+
+            size_t copied = copy_data(scratch[0], targets[i], std::max(duplicated, (ssize_t) 0));
+
+            if(duplicated != length || copied != (size_t) length)
+            {
+                discard_data(scratch[0], std::max(duplicated, (ssize_t) 0) - copied);
+                close(targets[i]);
+                targets.erase(targets.begin() + i);
+                continue;
+            }
+
+            i++;
+        }
+
+        size_t copied = copy_data(in, targets.back(), length);
+
+        if(copied != (size_t) length)
+        {
+            discard_data(in, length - copied);
+            close(targets.back());
+            targets.pop_back();
+        }
+    }
+
+    // down to one file, which can take the data straight out of the pipe
+    if(!targets.empty())
+        copy_data(in, targets[0], SIZE_MAX);
+
+    return true;
+}
+#endif
+
+
+/*
+ * Copies everything written to the pipe to every target until the
+ * command (and anything else holding the other end) is done with it.
+ */
+static void relay_output(int in, std::vector<int>& targets)
+{
+#if defined(__linux__)
+    if(tee_relay(in, targets))
+        return;
+#endif
+
+    char buf[RELAY_BUFFER_SIZE];
+
+    while(!targets.empty())
+    {
+        ssize_t n = read(in, buf, sizeof(buf));
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return;
+
+        for(size_t i = 0; i < targets.size();)
+        {
+            if(write_all(targets[i], buf, n))
+            {
+                i++;
+                continue;
+            }
+
+            close(targets[i]);
+            targets.erase(targets.begin() + i);
+        }
+    }
+}
+
+
+/*
+ * Forks a helper process that runs with the given end of a new pipe, and
+ * points fd at the other end in this process.
+ */
+static bool start_helper(int fd, bool helper_writes, std::vector<int>& files, std::vector<relay_helper_t>& helpers, \
+    std::vector<std::pair<int, int>> *saved)
+{
+    int fds[2];
+    if(pipe(fds) != 0)
+    {
+        redirection_error("pipe");
+        return false;
+    }
+
+#if defined(__linux__)
+    fcntl(fds[1], F_SETPIPE_SZ, RELAY_PIPE_SIZE);
+#endif
+
+    int helper_end = helper_writes ? fds[1] : fds[0];
+    int command_end = helper_writes ? fds[0] : fds[1];
+
+    pid_t pid = fork();
+    if(pid < 0)
+    {
+        redirection_error("fork");
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+
+    if(pid == 0)
+    {
+        close(command_end);
+
+        // the helper must not keep any of the command's streams open
+        for(int std_fd = STDIN_FILENO; std_fd <= STDERR_FILENO; std_fd++)
+        {
+            if(std_fd != helper_end && std::find(files.begin(), files.end(), std_fd) == files.end())
+                close(std_fd);
+        }
+
+        if(helper_writes)
+        {
+            for(int file : files)
+            {
+                copy_data(file, helper_end, SIZE_MAX);
+                close(file);
+            }
+        }
+        else
+        {
+            relay_output(helper_end, files);
+        }
+
+        _exit(0);
+    }
+
+    relay_helper_t helper;
+    helper.fd = fd;
+    helper.pid = pid;
+    helpers.push_back(helper);
+
+    for(int file : files)
+        close(file);
+
+    close(helper_end);
+    prepare_fd(fd, saved);
+    dup2(command_end, fd);
+    close(command_end);
+
+    return true;
+}
+
+
+static bool redirect_stream(int fd, std::vector<std::string>& paths, int flags, bool input, \
+    std::vector<relay_helper_t>& helpers, std::vector<std::pair<int, int>> *saved)
+{
+    std::vector<int> files;
+    if(!open_redirect_files(paths, flags, files))
+        return false;
+
+    if(files.size() == 1)
+    {
+        prepare_fd(fd, saved);
+        dup2(files[0], fd);
+        close(files[0]);
+        return true;
+    }
+
+    return start_helper(fd, input, files, helpers, saved);
+}
+
+
+static bool redirect_fd(fd_redirection_t& redirection, std::vector<std::pair<int, int>> *saved)
+{
+    if(redirection.action == FD_CLOSE)
+    {
+        prepare_fd(redirection.fd, saved);
+        close(redirection.fd);
+        return true;
+    }
+
+    if(redirection.action == FD_DUPLICATE)
+    {
+        if(!is_fd_open(redirection.source_fd))
+        {
+            errno = EBADF;
+            redirection_error(std::to_string(redirection.source_fd));
+            return false;
+        }
+
+        if(redirection.source_fd != redirection.fd)
+        {
+            prepare_fd(redirection.fd, saved);
+            dup2(redirection.source_fd, redirection.fd);
+        }
+
+        return true;
+    }
+
+    int flags = O_RDONLY;
+    if(redirection.action == FD_OPEN_WRITE)
+        flags = O_WRONLY | O_CREAT | O_TRUNC;
+    else if(redirection.action == FD_OPEN_APPEND)
+        flags = O_WRONLY | O_CREAT | O_APPEND;
+
+    int file = open(redirection.path.c_str(), flags | O_CLOEXEC, REDIRECT_FILE_MODE);
+    if(file < 0)
+    {
+        redirection_error(redirection.path);
+        return false;
+    }
+
+    prepare_fd(redirection.fd, saved);
+
+    // commands inherit the descriptor, so it must not be close-on-exec
+    if(file == redirection.fd)
+    {
+        fcntl(file, F_SETFD, 0);
+        return true;
+    }
+
+    dup2(file, redirection.fd);
+    close(file);
+    return true;
+}
+
+
+/*
+ * Applies every redirection of a command: the standard input, output,
+ * and error files first, then the numbered descriptors in order. Standard
+ * input is only redirected for the first command of a pipeline and
+ * standard output for the last.
+ */
+static bool apply_redirections(Command& command, bool first_command, bool last_command, \
+    std::vector<relay_helper_t>& helpers, std::vector<std::pair<int, int>> *saved)
+{
+    int output_flags = O_WRONLY | O_CREAT | (command.isOutputAppended() ? O_APPEND : O_TRUNC);
+
+    // redirect input
+    if(command.isInputRedirected() && first_command)
+    {
+        if(!redirect_stream(STDIN_FILENO, command.getInputFiles(), O_RDONLY, true, helpers, saved))
+            return false;
+    }
+
+    // redirect output
+    if(command.isOutputRedirected() && last_command)
+    {
+        if(!redirect_stream(STDOUT_FILENO, command.getOutputFiles(), output_flags, false, helpers, saved))
+            return false;
+    }
+
+    // redirect error. &> names one file for both, and they must share it
+    if(command.isErrorRedirected())
+    {
+        if(last_command && command.isOutputRedirected() && command.getErrorFiles() == command.getOutputFiles())
+        {
+            prepare_fd(STDERR_FILENO, saved);
+            dup2(STDOUT_FILENO, STDERR_FILENO);
+        }
+        else if(!redirect_stream(STDERR_FILENO, command.getErrorFiles(), O_WRONLY | O_CREAT | O_TRUNC, \
+            false, helpers, saved))
+        {
+            return false;
+        }
+    }
+
+    for(fd_redirection_t& redirection : command.getFdRedirections())
+    {
+        if(!redirect_fd(redirection, saved))
+            return false;
+    }
+
+    return true;
+}
+
+
+// the command the supervisor passes signals on to
+static volatile pid_t supervised_pid = -1;
+
+// the signals that are meant for the command rather than its supervisor
+static const int forwarded_signals[] = {SIGTERM, SIGINT, SIGHUP, SIGQUIT};
+
+
+static void forward_signal(int signal_number)
+{
+    kill(supervised_pid, signal_number);
+}
+
+
+/*
+ * Runs the rest of the command in a new process and waits for it and the
+ * helpers. This process has to stay around so that whoever is waiting on
+ * the command also waits for the relays to finish writing the files, and
+ * it passes the signals it is sent (by the watchdog, or from the terminal)
+ * on to the command.
+ *
+ * With a deadline, the command and the relays are put in a process group
+ * whose id is this process's pid, which the watchdog kills along with this
+ * process if SIGKILL is due. This process itself goes back to the shell's
+ * group, so it still gets the terminal's signals. Like the timeout
+ * program, a command in its own group is stopped if it reads from the
+ * terminal.
+ */
+static void supervise_helpers(std::vector<relay_helper_t>& helpers, bool has_deadline)
+{
+    pid_t shell_group = getpgrp();
+
+    if(has_deadline && setpgid(0, 0) == 0)
+    {
+        for(relay_helper_t& helper : helpers)
+            setpgid(helper.pid, getpid());
+    }
+
+    // blocked until the handlers are installed, so that a signal sent in
+    // the meantime is still passed on
+    sigset_t forwarded, old_mask;
+    sigemptyset(&forwarded);
+    for(int signal_number : forwarded_signals)
+        sigaddset(&forwarded, signal_number);
+
+    sigprocmask(SIG_BLOCK, &forwarded, &old_mask);
+
+    pid_t pid = fork();
+    if(pid < 0)
+    {
+        redirection_error("fork");
+        flush_all_output();
+        _exit(1);
+    }
+
+    if(pid == 0)
+    {
+        sigprocmask(SIG_SETMASK, &old_mask, NULL);
+        return;
+    }
+
+    if(getpgrp() != shell_group)
+        setpgid(0, shell_group);
+
+    supervised_pid = pid;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = forward_signal;
+    sigemptyset(&action.sa_mask);
+
+    for(int signal_number : forwarded_signals)
+        sigaction(signal_number, &action, NULL);
+
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+
+    // the relays see the end of their input once the command has exited
+    close(STDIN_FILENO);
+    close(STDOUT_FILENO);
+    close(STDERR_FILENO);
+
+    int status = 0;
+    while(waitpid(pid, &status, 0) < 0 && errno == EINTR)
+        ;
+
+    for(relay_helper_t& helper : helpers)
+    {
+        while(waitpid(helper.pid, NULL, 0) < 0 && errno == EINTR)
+            ;
+    }
+
+    if(WIFSIGNALED(status))
+        _exit(128 + WTERMSIG(status));
+
+    _exit(WEXITSTATUS(status));
+}
+
+
+
+void do_redirection(Job& job, Command& current_command, int command_number, bool has_deadline)
+{
+    std::vector<relay_helper_t> helpers;
+    bool last_command = (command_number == job.getNumCommands()-1);
+
+    if(!apply_redirections(current_command, command_number == 0, last_command, helpers, NULL))
+    {
+        flush_all_output();
+        _exit(1);
+    }
+
+    if(!helpers.empty())
+        supervise_helpers(helpers, has_deadline);
+}
+
+
+/*
+ * Makes the redirections of exec permanent. They are applied like any
+ * other, so they can be undone if one fails, and then the saved copies
+ * are dropped. A helper of a descriptor that was redirected again has
+ * lost the shell's end of its pipe, so it is waited for here.
+ */
+static int redirect_shell_permanently(Command& command)
+{
+    shell_redirection_t changed;
+
+    if(!apply_redirections(command, true, true, changed.helpers, &changed.saved_fds))
+    {
+        restore_shell_redirection(changed);
+        return -1;
+    }
+
+    for(std::pair<int, int>& saved_fd : changed.saved_fds)
+    {
+        if(saved_fd.second >= 0)
+            close(saved_fd.second);
+
+        for(size_t i = 0; i < exec_helpers.size(); )
+        {
+            if(exec_helpers[i].fd != saved_fd.first)
+            {
+                i++;
+                continue;
+            }
+
+            while(waitpid(exec_helpers[i].pid, NULL, 0) < 0 && errno == EINTR)
+                ;
+
+            exec_helpers.erase(exec_helpers.begin() + i);
+        }
+    }
+
+    exec_helpers.insert(exec_helpers.end(), changed.helpers.begin(), changed.helpers.end());
+    return 0;
+}
+
+
+int redirect_shell(Command& command, shell_redirection_t *saved)
+{
+    // anything already buffered was meant for the descriptors as they are now
+    flush_all_output();
+
+    if(saved == NULL)
+        return redirect_shell_permanently(command);
+
+    if(apply_redirections(command, true, true, saved->helpers, &saved->saved_fds))
+        return 0;
+
+    restore_shell_redirection(*saved);
+    return -1;
+}
+
+
+void restore_shell_redirection(shell_redirection_t& saved)
+{
+    flush_all_output();
+
+    for(std::pair<int, int>& saved_fd : saved.saved_fds)
+        restore_fd(saved_fd.first, saved_fd.second);
+
+    // the relays finish once the shell no longer holds their pipes
+    for(relay_helper_t& helper : saved.helpers)
+    {
+        while(waitpid(helper.pid, NULL, 0) < 0 && errno == EINTR)
+            ;
+    }
+
+    saved.saved_fds.clear();
+    saved.helpers.clear();
+}
+
+
+void finish_shell_redirections()
+{
+    flush_all_output();
+
+    for(relay_helper_t& helper : exec_helpers)
+        close(helper.fd);
+
+    for(relay_helper_t& helper : exec_helpers)
+    {
+        while(waitpid(helper.pid, NULL, 0) < 0 && errno == EINTR)
+            ;
+    }
+
+    exec_helpers.clear();
+}
@@ -0,0 +1,248 @@
+/*
+ * File: resource_limits.cc
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * This file implements the options shared by the ulimit builtin and the
+ * limit prefix, on top of getrlimit and setrlimit.
+ */
+
+
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+
+#include <output.h>
+#include <resource_limits.h>
+
+
+static const limit_type_t limit_types[] =
+{
+    {'c', RLIMIT_CORE, 1024, "core file size (KiB)"},
+    {'d', RLIMIT_DATA, 1024, "data segment size (KiB)"},
+    {'f', RLIMIT_FSIZE, 1024, "file size (KiB)"},
+    {'l', RLIMIT_MEMLOCK, 1024, "locked memory (KiB)"},
+    {'m', RLIMIT_RSS, 1024, "resident set size (KiB)"},
+    {'n', RLIMIT_NOFILE, 1, "open files"},
+    {'s', RLIMIT_STACK, 1024, "stack size (KiB)"},
+    {'t', RLIMIT_CPU, 1, "cpu time (seconds)"},
+    {'u', RLIMIT_NPROC, 1, "user processes"},
+    {'v', RLIMIT_AS, 1024, "virtual memory (KiB)"}
+};
+
+#define NUM_LIMIT_TYPES (sizeof(limit_types) / sizeof(limit_types[0]))
+
+// whether a limit of this process has been set since it started
+static bool limits_were_changed = false;
+
+
+static const limit_type_t *find_limit_type(char option)
+{
+    for(size_t i = 0; i < NUM_LIMIT_TYPES; i++)
+    {
+        if(limit_types[i].option == option)
+            return &limit_types[i];
+    }
+
+    return NULL;
+}
+
+
+static bool is_limit_value(const std::string& token)
+{
+    if(token.compare("unlimited") == 0)
+        return true;
+
+    return !token.empty() && token.find_first_not_of("0123456789") == std::string::npos;
+}
+
+
+/*
+ * Converts a value given in the limit's units. Returns false if it does
+ * not fit in a limit.
+ */
+static bool parse_limit_value(const std::string& token, const limit_type_t *type, rlim_t& value)
+{
+    if(token.compare("unlimited") == 0)
+    {
+        value = RLIM_INFINITY;
+        return true;
+    }
+
+    errno = 0;
+    unsigned long long number = strtoull(token.c_str(), NULL, 10);
+
+    if(errno != 0 || number > (RLIM_INFINITY - 1) / type->unit)
+        return false;
+
+    value = (rlim_t) number * type->unit;
+    return true;
+}
+
+
+int parse_limit_arguments(const std::vector<std::string>& tokens, size_t first, bool values_required, \
+    limit_arguments_t& arguments)
+{
+    arguments.soft = false;
+    arguments.hard = false;
+    arguments.all = false;
+    arguments.requests.clear();
+
+    size_t i = first;
+    while(i < tokens.size() && tokens[i].size() == 2 && tokens[i][0] == '-')
+    {
+        char option = tokens[i][1];
+        i++;
+
+        if(option == 'S')
+        {
+            arguments.soft = true;
+            continue;
+        }
+
+        if(option == 'H')
+        {
+            arguments.hard = true;
+            continue;
+        }
+
+        if(option == 'a' && !values_required)
+        {
+            arguments.all = true;
+            continue;
+        }
+
+        limit_request_t request;
+        request.type = find_limit_type(option);
+        request.has_value = false;
+
+        if(request.type == NULL)
+        {
+            print_error(std::string("-") + option + ": not a resource limit");
+            return -1;
+        }
+
+        if(i < tokens.size() && is_limit_value(tokens[i]))
+        {
+            if(!parse_limit_value(tokens[i], request.type, request.value))
+            {
+                print_error(tokens[i] + ": limit out of range");
+                return -1;
+            }
+
+            request.has_value = true;
+            i++;
+        }
+        else if(values_required)
+        {
+            print_error(std::string("-") + option + ": needs a value or 'unlimited'");
+            return -1;
+        }
+
+        arguments.requests.push_back(request);
+    }
+
+    return i;
+}
+
+
+int set_limits(limit_arguments_t& arguments)
+{
+    // like ulimit, both limits are set unless only one was asked for
+    bool set_soft = arguments.soft || !arguments.hard;
+    bool set_hard = arguments.hard || !arguments.soft;
+
+    for(limit_request_t& request : arguments.requests)
+    {
+        if(!request.has_value)
+            continue;
+
+        struct rlimit limit;
+        if(getrlimit(request.type->resource, &limit) != 0)
+        {
+            print_error(std::string("-") + request.type->option + ": " + strerror(errno));
+            return -1;
+        }
+
+        if(set_soft)
+            limit.rlim_cur = request.value;
+        if(set_hard)
+            limit.rlim_max = request.value;
+
+        if(setrlimit(request.type->resource, &limit) != 0)
+        {
+            print_error(std::string("-") + request.type->option + ": " + strerror(errno));
+            return -1;
+        }
+
+        limits_were_changed = true;
+    }
+
+    return 0;
+}
+
+
+bool limits_changed()
+{
+    return limits_were_changed;
+}
+
+
+static std::string format_limit(const limit_type_t *type, bool hard)
+{
+    struct rlimit limit;
+    if(getrlimit(type->resource, &limit) != 0)
+        return strerror(errno);
+
+    rlim_t value = hard ? limit.rlim_max : limit.rlim_cur;
+    if(value == RLIM_INFINITY)
+        return "unlimited";
+
+    return std::to_string((unsigned long long) (value / type->unit));
+}
+
+
+void print_limits(limit_arguments_t& arguments)
+{
+    // the soft limit is shown unless only the hard one was asked for
+    bool hard = arguments.hard && !arguments.soft;
+
+    std::vector<const limit_type_t*> shown;
+
+    if(arguments.all)
+    {
+        for(size_t i = 0; i < NUM_LIMIT_TYPES; i++)
+            shown.push_back(&limit_types[i]);
+    }
+    else
+    {
+        for(limit_request_t& request : arguments.requests)
+        {
+            if(!request.has_value)
+                shown.push_back(request.type);
+        }
+
+        if(arguments.requests.empty())
+            shown.push_back(find_limit_type('f'));
+    }
+
+    // a single limit is printed bare, so scripts can use it
+    if(shown.size() == 1 && !arguments.all)
+    {
+        print_output(format_limit(shown[0], hard));
+        return;
+    }
+
+    char line[128];
+    for(const limit_type_t *type : shown)
+    {
+        snprintf(line, sizeof(line), "%-26s (-%c) %s", type->description, type->option, \
+            format_limit(type, hard).c_str());
+        print_output(line);
+    }
+}
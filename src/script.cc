@@ -0,0 +1,188 @@
+/*
+ * File: script.cc
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * This file implements running shell scripts in the current shell process.
+ * Each script is read and split into tokens once, and its lines are cached,
+ * keyed by the identity of the file, until the file changes. A line is
+ * parsed the first time it runs, and the parse is kept along with the
+ * alias generation it was made under. It is only parsed again once an
+ * alias has changed, so it always sees the aliases that the lines before
+ * it defined, and sourcing an unchanged script again parses nothing.
+ */
+
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+
+#include <alias.h>
+#include <hashtable.h>
+#include <job.h>
+#include <main.h>
+#include <output.h>
+#include <parse.h>
+#include <script.h>
+#include <stats.h>
+
+
+/*
+ * A cached script is identified by the device and inode of the file, and
+ * is only valid while the modification time and size are unchanged.
+ */
+typedef std::pair<dev_t, ino_t> script_key_t;
+
+typedef struct
+{
+    struct timespec mtime;
+    off_t size;
+    std::shared_ptr<std::vector<script_line_t>> lines;
+} cached_script_t;
+
+
+static Table<script_key_t, cached_script_t> script_cache;
+
+
+
+/*
+ * Wrapper for the modification time field of struct stat, which has a
+ * different name on Mac OSX than on Linux.
+ */
+static struct timespec get_mtime(struct stat& file_stat)
+{
+#if defined(__APPLE__) || defined(__MACH__)
+    return file_stat.st_mtimespec;
+#else
+    return file_stat.st_mtim;
+#endif
+}
+
+
+/*
+ * Reads the script and splits every line into tokens. Blank lines and
+ * lines starting with '#' are skipped.
+ */
+static std::shared_ptr<std::vector<script_line_t>> read_script(std::string path)
+{
+    std::ifstream script_file(path);
+    if(!script_file.is_open())
+        throw std::runtime_error(path + ": " + strerror(errno));
+
+    std::shared_ptr<std::vector<script_line_t>> lines = std::make_shared<std::vector<script_line_t>>();
+    std::string line;
+    int line_number = 0;
+
+    while(std::getline(script_file, line))
+    {
+        line_number++;
+
+        // skip leading whitespace like the command line does
+        size_t start = line.find_first_not_of(" \t\r");
+        if(start == std::string::npos || line[start] == '#')
+            continue;
+
+        size_t stop = line.find_last_not_of(" \t\r");
+        line = line.substr(start, stop-start+1);
+
+        script_line_t script_line;
+        script_line.line_number = line_number;
+        script_line.tokens = tokenize(line, " ");
+        script_line.parsed = false;
+        script_line.alias_generation = 0;
+        script_line.valid = false;
+        lines->push_back(script_line);
+    }
+
+    return lines;
+}
+
+
+std::shared_ptr<std::vector<script_line_t>> get_script(std::string path)
+{
+    struct stat file_stat;
+    if(stat(path.c_str(), &file_stat) != 0)
+        throw std::runtime_error(path + ": " + strerror(errno));
+
+    script_key_t key(file_stat.st_dev, file_stat.st_ino);
+    struct timespec mtime = get_mtime(file_stat);
+
+    if(script_cache.contains(key))
+    {
+        cached_script_t cached = script_cache[key];
+
+        if(cached.mtime.tv_sec == mtime.tv_sec && cached.mtime.tv_nsec == mtime.tv_nsec \
+            && cached.size == file_stat.st_size)
+        {
+            count_stat(STAT_SCRIPT_CACHE_HITS);
+            return cached.lines;
+        }
+
+        script_cache.remove(key);
+    }
+
+    count_stat(STAT_SCRIPT_CACHE_MISSES);
+
+    cached_script_t cached;
+    cached.mtime = mtime;
+    cached.size = file_stat.st_size;
+    cached.lines = read_script(path);
+
+    script_cache.insert(key, cached);
+
+    return cached.lines;
+}
+
+
+int source_script(std::string path)
+{
+    std::shared_ptr<std::vector<script_line_t>> lines;
+
+    try
+    {
+        lines = get_script(path);
+    }
+    catch(const std::runtime_error& e)
+    {
+        print_error(e.what());
+        return -1;
+    }
+
+    /*
+     * the shared pointer keeps the lines alive even if the script sources
+     * itself after being modified and the cache entry is replaced
+     */
+    int result = 0;
+
+    for(script_line_t& line : *lines)
+    {
+        if(!line.parsed || line.alias_generation != get_alias_generation())
+        {
+            line.valid = parse_tokens(line.tokens, line.list);
+            line.alias_generation = get_alias_generation();
+            line.parsed = true;
+        }
+
+        if(!line.valid)
+        {
+            print_error(path + ":" + std::to_string(line.line_number) + ": Parse error. Please enter correct syntax.");
+            result = -1;
+            continue;
+        }
+
+        // running the jobs changes them (e.g. $? is expanded in place)
+        JobList list = line.list;
+        execute_list(list);
+    }
+
+    return result;
+}
+
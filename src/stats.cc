@@ -0,0 +1,230 @@
+/*
+ * File: stats.cc
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * This file implements the counters and histograms reported by the stats
+ * builtin.
+ */
+
+
+#include <atomic>
+#include <new>
+#include <string>
+
+#include <stdio.h>
+#include <time.h>
+#include <sys/mman.h>
+
+
+#include <output.h>
+#include <stats.h>
+
+
+// one bucket for each of the values below STATS_SUB_BUCKETS, then
+// STATS_SUB_BUCKETS for each power of two from there up to 2^63
+#define STATS_BUCKETS ((64 - STATS_SUB_BUCKET_BITS + 1) * STATS_SUB_BUCKETS)
+
+
+typedef struct
+{
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[STATS_BUCKETS];
+} histogram_t;
+
+
+static const char *counter_names[NUM_STAT_COUNTERS] =
+{
+    "forks",
+    "execs",
+    "exec_failures",
+    "script_cache_hits",
+    "script_cache_misses",
+    "parse_errors",
+    "builtin_calls"
+};
+
+static const char *histogram_names[NUM_STAT_HISTOGRAMS] =
+{
+    "parse",
+    "spawn",
+    "foreground_job"
+};
+
+
+static std::atomic<uint64_t> private_counters[NUM_STAT_COUNTERS];
+static std::atomic<uint64_t> *counters = private_counters;
+
+static histogram_t histograms[NUM_STAT_HISTOGRAMS];
+
+
+
+void start_stats()
+{
+    void *memory = mmap(NULL, sizeof(private_counters), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(memory == MAP_FAILED)
+        return;
+
+    counters = new(memory) std::atomic<uint64_t>[NUM_STAT_COUNTERS];
+    for(int i = 0; i < NUM_STAT_COUNTERS; i++)
+        counters[i].store(private_counters[i].load());
+}
+
+
+void count_stat(stat_counter_t counter)
+{
+    counters[counter].fetch_add(1, std::memory_order_relaxed);
+}
+
+
+uint64_t stats_clock()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+
+
+/**************
+ * Histograms *
+ **************/
+
+static int bucket_index(uint64_t value)
+{
+    if(value < STATS_SUB_BUCKETS)
+        return value;
+
+    int magnitude = 63 - __builtin_clzll(value);
+    int shift = magnitude - STATS_SUB_BUCKET_BITS;
+    int sub_bucket = (value >> shift) - STATS_SUB_BUCKETS;
+
+    return (shift + 1) * STATS_SUB_BUCKETS + sub_bucket;
+}
+
+
+/*
+ * Returns the middle of the range of values recorded in a bucket.
+ */
+static uint64_t bucket_value(int index)
+{
+    if(index < STATS_SUB_BUCKETS)
+        return index;
+
+    int shift = index / STATS_SUB_BUCKETS - 1;
+    uint64_t lowest = (uint64_t) (STATS_SUB_BUCKETS + index % STATS_SUB_BUCKETS) << shift;
+
+    return lowest + ((uint64_t) 1 << shift) / 2;
+}
+
+
+void record_stat(stat_histogram_t histogram, uint64_t start)
+{
+    uint64_t value = stats_clock() - start;
+    histogram_t& recorded = histograms[histogram];
+
+    recorded.count++;
+    recorded.sum += value;
+    recorded.buckets[bucket_index(value)]++;
+
+    if(value > recorded.max)
+        recorded.max = value;
+}
+
+
+/*
+ * Returns the value below which the given fraction of the recorded values
+ * fall. The largest value is exact rather than its bucket's.
+ */
+static uint64_t percentile(histogram_t& histogram, double fraction)
+{
+    uint64_t target = (uint64_t) (fraction * histogram.count + 0.5);
+    if(target == 0)
+        target = 1;
+
+    uint64_t seen = 0;
+    for(int i = 0; i < STATS_BUCKETS; i++)
+    {
+        seen += histogram.buckets[i];
+        if(seen >= target)
+            return (seen == histogram.count) ? histogram.max : bucket_value(i);
+    }
+
+    return histogram.max;
+}
+
+
+
+/**********
+ * Output *
+ **********/
+
+static void print_text()
+{
+    char line[160];
+
+    print_output("counters");
+    for(int i = 0; i < NUM_STAT_COUNTERS; i++)
+    {
+        snprintf(line, sizeof(line), "  %-22s %12llu", counter_names[i], \
+            (unsigned long long) counters[i].load(std::memory_order_relaxed));
+        print_output(line);
+    }
+
+    print_output("histograms (microseconds)");
+    snprintf(line, sizeof(line), "  %-22s %10s %10s %10s %10s %10s %10s", "", "count", "mean", "p50", "p90", \
+        "p99", "max");
+    print_output(line);
+
+    for(int i = 0; i < NUM_STAT_HISTOGRAMS; i++)
+    {
+        histogram_t& histogram = histograms[i];
+        double mean = histogram.count ? (double) histogram.sum / histogram.count : 0;
+
+        snprintf(line, sizeof(line), "  %-22s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f", histogram_names[i], \
+            (unsigned long long) histogram.count, mean / 1000, percentile(histogram, 0.5) / 1000.0, \
+            percentile(histogram, 0.9) / 1000.0, percentile(histogram, 0.99) / 1000.0, histogram.max / 1000.0);
+        print_output(line);
+    }
+}
+
+
+static void print_json()
+{
+    std::string json = "{\"counters\":{";
+    char field[256];
+
+    for(int i = 0; i < NUM_STAT_COUNTERS; i++)
+    {
+        snprintf(field, sizeof(field), "%s\"%s\":%llu", i ? "," : "", counter_names[i], \
+            (unsigned long long) counters[i].load(std::memory_order_relaxed));
+        json += field;
+    }
+
+    json += "},\"histograms_ns\":{";
+
+    for(int i = 0; i < NUM_STAT_HISTOGRAMS; i++)
+    {
+        histogram_t& histogram = histograms[i];
+
+        snprintf(field, sizeof(field), "%s\"%s\":{\"count\":%llu,\"mean\":%llu,\"p50\":%llu,\"p90\":%llu," \
+            "\"p99\":%llu,\"max\":%llu}", i ? "," : "", histogram_names[i], (unsigned long long) histogram.count, \
+            (unsigned long long) (histogram.count ? histogram.sum / histogram.count : 0), \
+            (unsigned long long) percentile(histogram, 0.5), (unsigned long long) percentile(histogram, 0.9), \
+            (unsigned long long) percentile(histogram, 0.99), (unsigned long long) histogram.max);
+        json += field;
+    }
+
+    json += "}}";
+    print_output(json);
+}
+
+
+void print_stats(bool json)
+{
+    if(json)
+        print_json();
+    else
+        print_text();
+}
@@ -0,0 +1,227 @@
+/*
+ * File: trace.cc
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * This file implements the trace ring and writes it out as Chrome trace
+ * events. Each slot has a sequence number that is cleared while the slot
+ * is being written and set to its index plus one once it is complete, so
+ * the writer at exit only prints events that were written completely.
+ */
+
+
+#include <atomic>
+#include <new>
+#include <string>
+
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+
+
+#include <output.h>
+#include <trace.h>
+
+
+typedef struct
+{
+    std::atomic<uint64_t> sequence;
+    const char *name;
+    uint64_t start;
+    uint64_t end;
+    pid_t pid;
+    char phase;
+    char detail[TRACE_DETAIL_LENGTH];
+} trace_event_t;
+
+
+typedef struct
+{
+    std::atomic<uint64_t> next;
+    trace_event_t events[TRACE_RING_EVENTS];
+} trace_ring_t;
+
+
+bool trace_enabled = false;
+
+static trace_ring_t *trace_ring = NULL;
+static std::string trace_path;
+static pid_t trace_owner = -1;
+
+
+
+uint64_t trace_clock()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+
+void start_tracing()
+{
+    const char *path = getenv("JOSH_TRACE");
+    if(path == NULL || path[0] == '\0')
+        return;
+
+    trace_path = path;
+    unsetenv("JOSH_TRACE");
+
+    // shared, so the children's events land in the same ring
+    void *memory = mmap(NULL, sizeof(trace_ring_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(memory == MAP_FAILED)
+    {
+        print_error("JOSH_TRACE: " + std::string(strerror(errno)));
+        return;
+    }
+
+    // the mapping starts zeroed, so every slot is already empty
+    trace_ring = new(memory) trace_ring_t;
+
+    trace_owner = getpid();
+    trace_enabled = true;
+}
+
+
+void trace_record(const char *name, char phase, pid_t pid, uint64_t start, uint64_t end, const char *detail)
+{
+    uint64_t index = trace_ring->next.fetch_add(1, std::memory_order_relaxed);
+    trace_event_t& event = trace_ring->events[index % TRACE_RING_EVENTS];
+
+    event.sequence.store(0, std::memory_order_relaxed);
+
+    event.name = name;
+    event.phase = phase;
+    event.pid = pid;
+    event.start = start;
+    event.end = end;
+
+    if(detail != NULL)
+    {
+        strncpy(event.detail, detail, TRACE_DETAIL_LENGTH-1);
+        event.detail[TRACE_DETAIL_LENGTH-1] = '\0';
+    }
+    else
+        event.detail[0] = '\0';
+
+    event.sequence.store(index+1, std::memory_order_release);
+}
+
+
+
+/**********
+ * Output *
+ **********/
+
+static void append_escaped(std::string& json, const char *text)
+{
+    for(const char *c = text; *c != '\0'; c++)
+    {
+        if(*c == '"' || *c == '\\')
+        {
+            json += '\\';
+            json += *c;
+        }
+        else if((unsigned char) *c < 0x20)
+            json += ' ';
+        else
+            json += *c;
+    }
+}
+
+
+static void append_event(std::string& json, trace_event_t& event, uint64_t origin)
+{
+    char numbers[128];
+
+    json += "{\"name\":\"";
+    append_escaped(json, event.phase == 'M' ? "process_name" : event.name);
+    json += "\",\"ph\":\"";
+    json += event.phase;
+
+    snprintf(numbers, sizeof(numbers), "\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f", (int) event.pid, (int) event.pid, \
+        (event.start - origin) / 1000.0);
+    json += numbers;
+
+    if(event.phase == 'X')
+    {
+        snprintf(numbers, sizeof(numbers), ",\"dur\":%.3f", (event.end - event.start) / 1000.0);
+        json += numbers;
+    }
+
+    if(event.phase == 'M')
+    {
+        json += ",\"args\":{\"name\":\"";
+        append_escaped(json, event.detail);
+        json += "\"}";
+    }
+    else if(event.detail[0] != '\0')
+    {
+        json += ",\"args\":{\"detail\":\"";
+        append_escaped(json, event.detail);
+        json += "\"}";
+    }
+
+    json += "}";
+}
+
+
+void finish_tracing()
+{
+    if(!trace_enabled || getpid() != trace_owner)
+        return;
+
+    trace_enabled = false;
+    trace_record("josh", 'M', trace_owner, 0, 0, "josh");
+
+    uint64_t next = trace_ring->next.load(std::memory_order_acquire);
+    uint64_t first = (next > TRACE_RING_EVENTS) ? next - TRACE_RING_EVENTS : 0;
+
+    // times are written relative to the first event, as Perfetto prefers
+    uint64_t origin = UINT64_MAX;
+    for(uint64_t i = first; i < next; i++)
+    {
+        trace_event_t& event = trace_ring->events[i % TRACE_RING_EVENTS];
+        if(event.sequence.load(std::memory_order_acquire) == i+1 && event.phase != 'M' && event.start < origin)
+            origin = event.start;
+    }
+
+    if(origin == UINT64_MAX)
+        origin = 0;
+
+    std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first_event = true;
+
+    for(uint64_t i = first; i < next; i++)
+    {
+        trace_event_t& event = trace_ring->events[i % TRACE_RING_EVENTS];
+        if(event.sequence.load(std::memory_order_acquire) != i+1)
+            continue;
+
+        if(event.phase == 'M')
+            event.start = origin;
+
+        if(!first_event)
+            json += ",\n";
+        first_event = false;
+
+        append_event(json, event, origin);
+    }
+
+    json += "\n]}\n";
+
+    int fd = open(trace_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0)
+    {
+        print_error(trace_path + ": " + strerror(errno));
+        return;
+    }
+
+    write_output(fd, json);
+    flush_output(fd);
+    close(fd);
+}
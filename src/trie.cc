@@ -0,0 +1,150 @@
+/*
+ * File: trie.cc
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * This file implements the reference counted prefix tree used to look up
+ * completions.
+ */
+
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+#include <trie.h>
+
+
+
+Trie::Trie()
+{
+    _size = 0;
+}
+
+
+Trie::~Trie()
+{
+
+}
+
+
+int Trie::size() const
+{
+    return _size;
+}
+
+
+void Trie::insert(const std::string& key)
+{
+    Node *node = &_root;
+
+    for(char c : key)
+    {
+        std::unique_ptr<Node>& child = node->children[c];
+        if(!child)
+            child.reset(new Node());
+
+        node = child.get();
+    }
+
+    if(node->count == 0)
+        _size++;
+
+    node->count++;
+}
+
+
+/*
+ * Decrements the reference count of the key and prunes the nodes that
+ * no longer lead to any string.
+ */
+void Trie::remove(const std::string& key)
+{
+    std::vector<Node*> path;
+    Node *node = &_root;
+
+    for(char c : key)
+    {
+        auto it = node->children.find(c);
+        if(it == node->children.end())
+            return;
+
+        path.push_back(node);
+        node = it->second.get();
+    }
+
+    if(node->count == 0)
+        return;
+
+    node->count--;
+    if(node->count > 0)
+        return;
+
+    _size--;
+
+    // walk back up, removing empty leaves
+    for(int i = key.size()-1; i >= 0; i--)
+    {
+        Node *child = path[i]->children[key[i]].get();
+        if(child->count > 0 || !child->children.empty())
+            break;
+
+        path[i]->children.erase(key[i]);
+    }
+}
+
+
+bool Trie::contains(const std::string& key) const
+{
+    const Node *node = &_root;
+
+    for(char c : key)
+    {
+        auto it = node->children.find(c);
+        if(it == node->children.end())
+            return false;
+
+        node = it->second.get();
+    }
+
+    return node->count > 0;
+}
+
+
+void Trie::collect(const Node *node, std::string& prefix, std::vector<std::string>& results) const
+{
+    if(node->count > 0)
+        results.push_back(prefix);
+
+    for(auto it = node->children.begin(); it != node->children.end(); ++it)
+    {
+        prefix.push_back(it->first);
+        collect(it->second.get(), prefix, results);
+        prefix.pop_back();
+    }
+}
+
+
+/*
+ * Returns every string starting with the prefix, in sorted order.
+ */
+std::vector<std::string> Trie::withPrefix(const std::string& prefix) const
+{
+    std::vector<std::string> results;
+    const Node *node = &_root;
+
+    for(char c : prefix)
+    {
+        auto it = node->children.find(c);
+        if(it == node->children.end())
+            return results;
+
+        node = it->second.get();
+    }
+
+    std::string current = prefix;
+    collect(node, current, results);
+
+    return results;
+}
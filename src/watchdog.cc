@@ -0,0 +1,228 @@
+/*
+ * File: watchdog.cc
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * This file implements the deadlines of foreground jobs. The shell opens a
+ * pidfd for each process of the job and polls all of them at once, with
+ * the time left until the next signal as poll's timeout, so it sleeps
+ * until a process exits or a signal is due.
+ */
+
+
+#include <string>
+#include <vector>
+
+#include <ctype.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+
+#include <output.h>
+#include <trace.h>
+#include <watchdog.h>
+
+
+// longer deadlines than this (about 31 years) are not accepted
+#define MAX_DURATION_MS 1000000000000.0
+
+
+
+bool parse_duration(const std::string& text, long& milliseconds)
+{
+    if(text.empty() || (!isdigit((unsigned char) text[0]) && text[0] != '.'))
+        return false;
+
+    char *end;
+    double value = strtod(text.c_str(), &end);
+    std::string suffix(end);
+
+    if(suffix.empty() || suffix.compare("s") == 0)
+        value *= 1000;
+    else if(suffix.compare("m") == 0)
+        value *= 60 * 1000;
+    else if(suffix.compare("h") == 0)
+        value *= 60 * 60 * 1000;
+    else if(suffix.compare("d") == 0)
+        value *= 24 * 60 * 60 * 1000;
+    else
+        return false;
+
+    if(value > MAX_DURATION_MS)
+        return false;
+
+    milliseconds = (long) value;
+    return true;
+}
+
+
+int parse_timeout_arguments(const std::vector<std::string>& tokens, size_t first, job_timeout_t& timeout)
+{
+    size_t i = first;
+    timeout.kill_after_ms = DEFAULT_KILL_AFTER_MS;
+
+    if(i < tokens.size() && tokens[i].compare("-k") == 0)
+    {
+        if(i+1 == tokens.size() || !parse_duration(tokens[i+1], timeout.kill_after_ms))
+            return -1;
+
+        i += 2;
+    }
+
+    if(i == tokens.size() || !parse_duration(tokens[i], timeout.duration_ms))
+        return -1;
+
+    return i+1;
+}
+
+
+job_timeout_t default_timeout()
+{
+    job_timeout_t timeout = {0, DEFAULT_KILL_AFTER_MS};
+
+    const char *duration = getenv("JOSH_TIMEOUT");
+    if(duration != NULL && !parse_duration(duration, timeout.duration_ms))
+        timeout.duration_ms = 0;
+
+    return timeout;
+}
+
+
+static void wait_without_deadline(const std::vector<pid_t>& pids, int *statuses)
+{
+    for(size_t i = 0; i < pids.size(); i++)
+    {
+        while(waitpid(pids[i], &statuses[i], 0) < 0 && errno == EINTR)
+            ;
+
+        trace_exit(pids[i]);
+    }
+}
+
+
+#if defined(__linux__) && defined(SYS_pidfd_open)
+
+static long now_ms()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000L + now.tv_nsec / 1000000;
+}
+
+
+void wait_for_processes(const std::vector<pid_t>& pids, const job_timeout_t& timeout, const std::string& name, \
+    std::vector<int>& statuses)
+{
+    statuses.assign(pids.size(), 0);
+
+    if(timeout.duration_ms <= 0)
+    {
+        wait_without_deadline(pids, statuses.data());
+        return;
+    }
+
+    std::vector<struct pollfd> pfds(pids.size());
+
+    for(size_t i = 0; i < pids.size(); i++)
+    {
+        pfds[i].fd = syscall(SYS_pidfd_open, pids[i], 0);
+        pfds[i].events = POLLIN;
+
+        // without a pidfd (before Linux 5.3) the job has no deadline
+        if(pfds[i].fd < 0)
+        {
+            for(size_t j = 0; j < i; j++)
+                close(pfds[j].fd);
+
+            wait_without_deadline(pids, statuses.data());
+            return;
+        }
+    }
+
+    size_t num_running = pids.size();
+    long next_signal_time = now_ms() + timeout.duration_ms;
+    int next_signal = SIGTERM;
+
+    while(num_running > 0)
+    {
+        long wait_ms = -1;
+        if(next_signal != 0)
+            wait_ms = (next_signal_time > now_ms()) ? next_signal_time - now_ms() : 0;
+
+        if(poll(pfds.data(), pfds.size(), wait_ms) < 0 && errno != EINTR)
+            break;
+
+        for(size_t i = 0; i < pfds.size(); i++)
+        {
+            if(pfds[i].fd < 0 || pfds[i].revents == 0)
+                continue;
+
+            while(waitpid(pids[i], &statuses[i], 0) < 0 && errno == EINTR)
+                ;
+
+            trace_exit(pids[i]);
+            close(pfds[i].fd);
+
+            // poll skips negative descriptors
+            pfds[i].fd = -1;
+            num_running--;
+        }
+
+        if(num_running == 0 || next_signal == 0 || now_ms() < next_signal_time)
+            continue;
+
+        if(next_signal == SIGTERM)
+            print_error(name + ": timed out");
+
+        // a process keeps its pid until it is reaped, so only the job's own
+        // processes can be signalled. A stage with several files for one
+        // stream passes SIGTERM on to its command, but it cannot pass on
+        // SIGKILL, so that goes to the command's process group as well
+        for(size_t i = 0; i < pfds.size(); i++)
+        {
+            if(pfds[i].fd < 0)
+                continue;
+
+            kill(pids[i], next_signal);
+            if(next_signal == SIGKILL)
+                kill(-pids[i], SIGKILL);
+        }
+
+        if(next_signal == SIGTERM)
+        {
+            next_signal = SIGKILL;
+            next_signal_time = now_ms() + timeout.kill_after_ms;
+        }
+        else
+            next_signal = 0;
+    }
+
+    // only left if poll failed
+    for(size_t i = 0; i < pfds.size(); i++)
+    {
+        if(pfds[i].fd < 0)
+            continue;
+
+        close(pfds[i].fd);
+        wait_without_deadline(std::vector<pid_t>(1, pids[i]), &statuses[i]);
+    }
+}
+
+#else
+
+void wait_for_processes(const std::vector<pid_t>& pids, const job_timeout_t& timeout, const std::string& name, \
+    std::vector<int>& statuses)
+{
+    statuses.assign(pids.size(), 0);
+    wait_without_deadline(pids, statuses.data());
+}
+
+#endif
@@ -0,0 +1,319 @@
+/*
+ * File: test_shell.cc
+ * Author: Joshua Jacobs-Rebhun
+ *
+ * End-to-end tests of the shell. Each test starts the shell with its
+ * standard input and output connected to pipes, sends it commands, and
+ * checks what they printed or what the shell left behind. Prints the name
+ * of every test that failed and exits with 1 if any did.
+ *
+ * Usage: test_shell [path to josh]
+ */
+
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+
+
+typedef struct
+{
+    pid_t pid;
+    int input;
+    int output;
+} shell_t;
+
+
+static const char *josh = "./josh";
+static int failures = 0;
+
+
+
+/******************
+ * Driving a shell *
+ ******************/
+
+static shell_t start_shell(const std::vector<std::string>& options)
+{
+    int input[2];
+    int output[2];
+    pipe(input);
+    pipe(output);
+
+    shell_t shell;
+    shell.pid = fork();
+
+    if(shell.pid == 0)
+    {
+        dup2(input[0], STDIN_FILENO);
+        dup2(output[1], STDOUT_FILENO);
+
+        // the errors some tests provoke on purpose would only be noise
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDERR_FILENO);
+        close(null);
+
+        close(input[0]);
+        close(input[1]);
+        close(output[0]);
+        close(output[1]);
+
+        std::vector<char*> argv;
+        argv.push_back((char*) josh);
+        for(const std::string& option : options)
+            argv.push_back((char*) option.c_str());
+        argv.push_back(NULL);
+
+        execv(josh, argv.data());
+        _exit(127);
+    }
+
+    close(input[0]);
+    close(output[1]);
+    shell.input = input[1];
+    shell.output = output[0];
+
+    return shell;
+}
+
+
+static void send(shell_t& shell, const std::string& commands)
+{
+    size_t sent = 0;
+    while(sent < commands.size())
+    {
+        ssize_t written = write(shell.input, commands.data() + sent, commands.size() - sent);
+        if(written <= 0)
+            return;
+        sent += written;
+    }
+}
+
+
+// reads one line of the shell's output, without the newline
+static std::string read_line(shell_t& shell)
+{
+    std::string line;
+    char c;
+
+    while(read(shell.output, &c, 1) == 1 && c != '\n')
+        line += c;
+
+    return line;
+}
+
+
+/*
+ * Runs a command in the shell and returns the first line it printed.
+ */
+static std::string run(shell_t& shell, const std::string& command)
+{
+    send(shell, command + "\n");
+    return read_line(shell);
+}
+
+
+// closes the shell's input and returns its exit status
+static int stop_shell(shell_t& shell)
+{
+    close(shell.input);
+
+    int status;
+    waitpid(shell.pid, &status, 0);
+    close(shell.output);
+
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+
+static void expect(bool passed, const std::string& test)
+{
+    if(passed)
+        return;
+
+    std::cout << "FAILED: " << test << std::endl;
+    failures++;
+}
+
+
+/*
+ * Returns the number of the shell's children that have exited and not been
+ * waited for.
+ */
+static int count_zombies(pid_t parent)
+{
+    DIR *proc = opendir("/proc");
+    if(proc == NULL)
+        return 0;
+
+    int zombies = 0;
+    struct dirent *entry;
+
+    while((entry = readdir(proc)) != NULL)
+    {
+        std::string path = std::string("/proc/") + entry->d_name + "/stat";
+        FILE *stat = fopen(path.c_str(), "r");
+        if(stat == NULL)
+            continue;
+
+        // the command name is in parentheses and may contain spaces
+        char line[512];
+        if(fgets(line, sizeof(line), stat) != NULL)
+        {
+            char *fields = strrchr(line, ')');
+            char state;
+            int ppid;
+
+            if(fields != NULL && sscanf(fields + 1, " %c %d", &state, &ppid) == 2 && ppid == parent && state == 'Z')
+                zombies++;
+        }
+
+        fclose(stat);
+    }
+
+    closedir(proc);
+    return zombies;
+}
+
+
+
+static std::string read_file(const std::string& path)
+{
+    std::ifstream file(path.c_str());
+    std::stringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+
+
+/*********
+ * Tests *
+ *********/
+
+/*
+ * A background job's process substitutions are reaped along with it.
+ */
+static void test_background_substitution()
+{
+    shell_t shell = start_shell({});
+
+    send(shell, "/bin/cat <(/bin/echo hi) > /dev/null &\n");
+    usleep(300000);
+
+    // every job starts by reaping the background jobs that have finished
+    run(shell, "pwd");
+    expect(count_zombies(shell.pid) == 0, "background process substitution is reaped");
+
+    stop_shell(shell);
+}
+
+
+
+/*
+ * Commands started by the fork server get the limits set with ulimit,
+ * although the server was started with the ones the shell had before.
+ */
+static void test_fork_server_limits()
+{
+    shell_t shell = start_shell({"--fork-server"});
+
+    send(shell, "ulimit -n 50\n");
+    std::string limits = run(shell, "/bin/grep Max.open.files /proc/self/limits");
+
+    // the line is the name followed by the soft and hard limits
+    long soft = -1;
+    sscanf(limits.c_str(), "Max open files %ld", &soft);
+    expect(soft == 50, "fork server command inherits ulimit -n");
+
+    stop_shell(shell);
+}
+
+
+
+/*
+ * A command that is not found exits 127, and the shell exits with the
+ * status of the last command when its input ends.
+ */
+static void test_exit_statuses()
+{
+    shell_t shell = start_shell({});
+
+    send(shell, "nosuchcommand\n");
+    expect(run(shell, "echo $?") == "127", "missing command exits 127");
+
+    send(shell, "/bin/false\n");
+    expect(stop_shell(shell) == 1, "shell exits with the last status");
+}
+
+
+
+/*
+ * The helper that copies a stream exec sent to several files is waited for
+ * when exec redirects the stream again, and when the shell exits.
+ */
+static void test_exec_relay()
+{
+    char directory[] = "/tmp/test_shell.XXXXXX";
+    if(mkdtemp(directory) == NULL)
+    {
+        expect(false, "exec relay temporary directory");
+        return;
+    }
+
+    std::string a = std::string(directory) + "/a";
+    std::string b = std::string(directory) + "/b";
+    std::string c = std::string(directory) + "/c";
+    std::string d = std::string(directory) + "/d";
+
+    shell_t shell = start_shell({});
+
+    send(shell, "exec 2> " + a + " 2> " + b + "\n");
+    send(shell, "/bin/echo one >&2\n");
+    send(shell, "exec 2> " + c + "\n");
+    run(shell, "pwd");
+    usleep(300000);
+    expect(count_zombies(shell.pid) == 0, "replaced exec relay is reaped");
+
+    send(shell, "exec 2> " + a + " 2> " + d + "\n");
+    send(shell, "/bin/echo two >&2\n");
+    stop_shell(shell);
+
+    expect(read_file(b) == "one\n", "exec relay writes every file");
+    expect(read_file(d) == "two\n", "exec relay finishes before the shell exits");
+
+    unlink(a.c_str());
+    unlink(b.c_str());
+    unlink(c.c_str());
+    unlink(d.c_str());
+    rmdir(directory);
+}
+
+
+
+int main(int argc, char *argv[])
+{
+    if(argc > 1)
+        josh = argv[1];
+
+    test_background_substitution();
+    test_fork_server_limits();
+    test_exit_statuses();
+    test_exec_relay();
+
+    if(failures > 0)
+        return 1;
+
+    std::cout << "All tests passed" << std::endl;
+    return 0;
+}